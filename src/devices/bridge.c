@@ -0,0 +1,204 @@
+#define _XOPEN_SOURCE 500
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../uxn.h"
+#include "bridge.h"
+
+/*
+Copyright (c) 2023 Devine Lu Linvega
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+/* children that did not exit on SIGTERM yet, killed after a second */
+static struct {
+	int pid, age;
+} reaping[0x10];
+
+static int
+bridge_unix(Bridge *b, char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) return 0;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return 0;
+	}
+	b->rfd = b->wfd = fd;
+	return 1;
+}
+
+static int
+bridge_fifo(Bridge *b, char *path)
+{
+	/* read only, a read-write descriptor would read back what is routed
+	 * to it, the held writer keeps it from ending between writers */
+	int fd = open(path, O_RDONLY | O_NONBLOCK);
+	if(fd < 0) return 0;
+	if((b->hold = open(path, O_WRONLY | O_NONBLOCK)) < 0) {
+		close(fd);
+		return 0;
+	}
+	b->rfd = fd, b->wfd = -1;
+	return 1;
+}
+
+static int
+bridge_exec(Bridge *b, char *cmd)
+{
+	int in[2], out[2];
+	if(pipe(in) < 0) return 0;
+	if(pipe(out) < 0) {
+		close(in[0]), close(in[1]);
+		return 0;
+	}
+	if((b->pid = fork()) < 0) {
+		close(in[0]), close(in[1]), close(out[0]), close(out[1]);
+		return 0;
+	}
+	if(!b->pid) {
+		dup2(in[0], 0), dup2(out[1], 1);
+		close(in[0]), close(in[1]), close(out[0]), close(out[1]);
+		signal(SIGPIPE, SIG_DFL);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+	close(in[0]), close(out[1]);
+	b->rfd = out[0], b->wfd = in[1];
+	return 1;
+}
+
+int
+bridge_spec(char *spec)
+{
+	return !strncmp(spec, "unix:", 5) || !strncmp(spec, "fifo:", 5) || !strncmp(spec, "exec:", 5);
+}
+
+int
+bridge_open(Bridge *b, char *spec)
+{
+	int ok = 0;
+	b->ready = b->pid = b->olen = 0, b->hold = -1;
+	signal(SIGPIPE, SIG_IGN);
+	if(!strncmp(spec, "unix:", 5))
+		ok = bridge_unix(b, spec + 5);
+	else if(!strncmp(spec, "fifo:", 5))
+		ok = bridge_fifo(b, spec + 5);
+	else if(!strncmp(spec, "exec:", 5))
+		ok = bridge_exec(b, spec + 5);
+	if(ok) {
+		/* keep the other bridges' children from holding these open */
+		fcntl(b->rfd, F_SETFD, FD_CLOEXEC), fcntl(b->rfd, F_SETFL, fcntl(b->rfd, F_GETFL) | O_NONBLOCK);
+		if(b->wfd >= 0)
+			fcntl(b->wfd, F_SETFD, FD_CLOEXEC), fcntl(b->wfd, F_SETFL, fcntl(b->wfd, F_GETFL) | O_NONBLOCK);
+		if(b->hold >= 0)
+			fcntl(b->hold, F_SETFD, FD_CLOEXEC);
+	}
+	return b->live = ok;
+}
+
+void
+bridge_close(Bridge *b)
+{
+	if(!b->live) return;
+	close(b->rfd);
+	if(b->wfd >= 0 && b->wfd != b->rfd)
+		close(b->wfd);
+	if(b->hold >= 0)
+		close(b->hold), b->hold = -1;
+	if(b->pid) {
+		int i;
+		kill(b->pid, SIGTERM);
+		for(i = 0; i < 0x10 && reaping[i].pid; i++)
+			continue;
+		if(i < 0x10)
+			reaping[i].pid = b->pid, reaping[i].age = 0;
+		else
+			kill(b->pid, SIGKILL), waitpid(b->pid, NULL, 0);
+	}
+	b->live = b->ready = b->pid = b->olen = 0;
+}
+
+void
+bridge_reap(void)
+{
+	int i;
+	for(i = 0; i < 0x10; i++) {
+		if(!reaping[i].pid) continue;
+		if(waitpid(reaping[i].pid, NULL, WNOHANG) != 0)
+			reaping[i].pid = 0;
+		else if(++reaping[i].age == 0x20)
+			kill(reaping[i].pid, SIGKILL);
+	}
+}
+
+void
+bridge_poll(Bridge **list, int len)
+{
+	struct pollfd fds[0x10];
+	int i;
+	if(len > 0x10) len = 0x10;
+	for(i = 0; i < len; i++)
+		fds[i].fd = list[i]->rfd, fds[i].events = POLLIN, fds[i].revents = 0;
+	if(poll(fds, len, 0) <= 0) return;
+	for(i = 0; i < len; i++)
+		list[i]->ready = !!(fds[i].revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+int
+bridge_read(Bridge *b, Uint8 *buf, int len)
+{
+	int n;
+	if(!b->live || !b->ready || !len) return 0;
+	n = read(b->rfd, buf, len);
+	if(n > 0) return n;
+	if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+		b->ready = 0;
+		return 0;
+	}
+	bridge_close(b);
+	return -1;
+}
+
+void
+bridge_flush(Bridge *b)
+{
+	int n;
+	if(!b->live || !b->olen || b->wfd < 0) return;
+	n = write(b->wfd, b->out, b->olen);
+	if(n < 0) {
+		if(errno != EAGAIN && errno != EINTR) b->olen = 0;
+		return;
+	}
+	memmove(b->out, b->out + n, b->olen - n);
+	b->olen -= n;
+}
+
+int
+bridge_write(Bridge *b, Uint8 c)
+{
+	if(!b->live || b->wfd < 0) return 0;
+	if(b->olen == BRIDGE_BUFFER)
+		bridge_flush(b);
+	if(b->olen == BRIDGE_BUFFER)
+		return 0;
+	b->out[b->olen++] = c;
+	return 1;
+}
@@ -0,0 +1,26 @@
+/*
+Copyright (c) 2023 Devine Lu Linvega
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE.
+*/
+
+#define BRIDGE_BUFFER 0x1000
+
+typedef struct Bridge {
+	int live, ready, rfd, wfd, hold, pid, olen;
+	Uint8 out[BRIDGE_BUFFER];
+} Bridge;
+
+int bridge_spec(char *spec);
+int bridge_open(Bridge *b, char *spec);
+void bridge_close(Bridge *b);
+void bridge_reap(void);
+void bridge_poll(Bridge **list, int len);
+int bridge_read(Bridge *b, Uint8 *buf, int len);
+int bridge_write(Bridge *b, Uint8 c);
+void bridge_flush(Bridge *b);
@@ -17,6 +17,8 @@ WITH REGARD TO THIS SOFTWARE.
 #define CONSOLE_ARG 0x2
 #define CONSOLE_EOA 0x3
 #define CONSOLE_END 0x4
+#define CONSOLE_BULK 0x5
+#define CONSOLE_BANK 0x6
 
 int console_input(Uxn *u, char c, int type);
 void console_listen(Uxn *u, int i, int argc, char **argv);
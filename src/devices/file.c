@@ -1,4 +1,5 @@
 #define _XOPEN_SOURCE 500
+#define _FILE_OFFSET_BITS 64
 #include <stdio.h>
 #include <dirent.h>
 #include <errno.h>
@@ -7,6 +8,10 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#endif
 
 #ifdef _WIN32
 #include <libiberty/libiberty.h>
@@ -15,6 +20,8 @@
 #define DIR_SEP_STR "\\"
 #define pathcmp(path1, path2, length) strncasecmp(path1, path2, length) /* strncasecmp provided by libiberty */
 #define notdriveroot(file_name) (file_name[0] != DIR_SEP_CHAR && ((strlen(file_name) > 2 && file_name[1] != ':') || strlen(file_name) <= 2))
+#define fseeko fseek
+#define ftello ftell
 #else
 #define DIR_SEP_CHAR '/'
 #define DIR_SEP_STR "/"
@@ -26,6 +33,8 @@
 #define PATH_MAX 4096
 #endif
 
+#define FILE_AHEAD 0x10000
+
 #include "../uxn.h"
 #include "file.h"
 
@@ -40,24 +49,74 @@ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
 WITH REGARD TO THIS SOFTWARE.
 */
 
-typedef struct {
+struct UxnFile {
 	FILE *f;
 	DIR *dir;
 	char current_filename[4096];
 	struct dirent *de;
+	Uint8 *ahead;
+	size_t pos, apos, alen;
+	Uint32 ageneration;
+	char *listing, listed[4096];
+	size_t llen, lcap, lpos;
+	int notify, watch, fresh;
 	enum { IDLE,
 		FILE_READ,
 		FILE_WRITE,
 		DIR_READ } state;
-	int outside_sandbox;
-} UxnFile;
+	int outside_sandbox, sync, error;
+	Uint32 seek;
+	struct UxnFile *next;
+};
 
-static UxnFile uxn_file[POLYFILEY];
+/* handles holding buffered writes, flushed before their file is read */
+static UxnFile *writers;
+/* bumped when writes may reach a file, read-ahead buffers refill */
+static Uint32 generation;
+
+static void
+writer_remove(UxnFile *c)
+{
+	UxnFile **w;
+	for(w = &writers; *w; w = &(*w)->next)
+		if(*w == c) {
+			*w = c->next;
+			return;
+		}
+}
+
+static int
+file_flush_handle(UxnFile *c)
+{
+	if(c->state != FILE_WRITE)
+		return !c->error;
+	if(fflush(c->f) || ferror(c->f))
+		c->error = 1;
+	generation++;
+	return !c->error;
+}
+
+static void
+file_flush_path(const char *path)
+{
+	struct stat st, wst;
+	UxnFile *w;
+	if(!writers || stat(path, &st)) return;
+	for(w = writers; w; w = w->next)
+		if(!fstat(fileno(w->f), &wst) && wst.st_dev == st.st_dev && wst.st_ino == st.st_ino)
+			file_flush_handle(w);
+}
 
 static void
 reset(UxnFile *c)
 {
+	if(c->state == FILE_WRITE)
+		writer_remove(c);
 	if(c->f != NULL) {
+#ifndef _WIN32
+		if(c->state == FILE_WRITE && c->sync && fflush(c->f) == 0)
+			fsync(fileno(c->f));
+#endif
 		fclose(c->f);
 		c->f = NULL;
 	}
@@ -66,6 +125,7 @@ reset(UxnFile *c)
 		c->dir = NULL;
 	}
 	c->de = NULL;
+	c->alen = 0;
 	c->state = IDLE;
 	c->outside_sandbox = 0;
 }
@@ -86,11 +146,53 @@ get_entry(char *p, Uint16 len, const char *pathname, const char *basename, int f
 		return snprintf(p, len, "???? %s\n", basename);
 }
 
+/* Note there's [currently] no way of chdir()ing from uxn, so $PWD
+ * is always the sandbox top level, it is resolved once. */
+
+static char sandbox[PATH_MAX];
+static size_t sandbox_len;
+static struct stat sandbox_st;
+
+/* directories already resolved by file_init, checked again by inode */
+static struct {
+	char path[PATH_MAX];
+	dev_t dev;
+	ino_t ino;
+	int inside;
+} sandbox_dirs[0x10];
+static int sandbox_next;
+
+static void
+file_sandbox(void)
+{
+	char cwd[PATH_MAX] = {'\0'}, *rp;
+	if(sandbox_len || !getcwd(cwd, sizeof(cwd)) || !(rp = realpath(cwd, NULL)))
+		return;
+	if(strlen(rp) < sizeof(sandbox) && !stat(rp, &sandbox_st))
+		strcpy(sandbox, rp), sandbox_len = strlen(rp);
+	free(rp);
+}
+
+static int
+file_is_sandbox(const char *dir)
+{
+	char cwd[PATH_MAX] = {'\0'}, *t;
+	struct stat st;
+	int same;
+	if(sandbox_len)
+		return !stat(dir, &st) && st.st_dev == sandbox_st.st_dev && st.st_ino == sandbox_st.st_ino;
+	getcwd(cwd, sizeof(cwd));
+	/* We already checked that the directory exists so don't need a wrapper. */
+	t = realpath(dir, NULL);
+	same = t && strcmp(cwd, t) == 0;
+	free(t);
+	return same;
+}
+
 static Uint16
 file_read_dir(UxnFile *c, char *dest, Uint16 len)
 {
-	static char pathname[4352];
-	char *p = dest;
+	char pathname[4352], *p = dest;
 	if(c->de == NULL) c->de = readdir(c->dir);
 	for(; c->de != NULL; c->de = readdir(c->dir)) {
 		Uint16 n;
@@ -98,17 +200,8 @@ file_read_dir(UxnFile *c, char *dest, Uint16 len)
 			continue;
 		if(strcmp(c->de->d_name, "..") == 0) {
 			/* hide "sandbox/.." */
-			char cwd[PATH_MAX] = {'\0'}, *t;
-			/* Note there's [currently] no way of chdir()ing from uxn, so $PWD
-			 * is always the sandbox top level. */
-			getcwd(cwd, sizeof(cwd));
-			/* We already checked that c->current_filename exists so don't need a wrapper. */
-			t = realpath(c->current_filename, NULL);
-			if(strcmp(cwd, t) == 0) {
-				free(t);
+			if(file_is_sandbox(c->current_filename))
 				continue;
-			}
-			free(t);
 		}
 		if(strlen(c->current_filename) + 1 + strlen(c->de->d_name) < sizeof(pathname))
 			snprintf(pathname, sizeof(pathname), "%s/%s", c->current_filename, c->de->d_name);
@@ -157,17 +250,90 @@ retry_realpath(const char *file_name)
 	return r;
 }
 
-static void
-file_check_sandbox(UxnFile *c)
+static int
+file_inside_resolved(const char *file_name)
 {
 	char *x, *rp, cwd[PATH_MAX] = {'\0'};
+	int inside;
 	x = getcwd(cwd, sizeof(cwd));
-	rp = retry_realpath(c->current_filename);
-	if(rp == NULL || (x && pathcmp(cwd, rp, strlen(cwd)) != 0)) {
+	rp = retry_realpath(file_name);
+	inside = rp != NULL && !(x && pathcmp(cwd, rp, strlen(cwd)) != 0);
+	free(rp);
+	return inside;
+}
+
+#ifndef _WIN32
+static int
+file_normalize(char *dst, const char *file_name)
+{
+	size_t len = 0, n;
+	const char *p = file_name, *q;
+	if(notdriveroot(file_name))
+		memcpy(dst, sandbox, sandbox_len), len = sandbox_len;
+	while(*p) {
+		while(*p == DIR_SEP_CHAR)
+			p++;
+		for(q = p; *q && *q != DIR_SEP_CHAR; q++)
+			continue;
+		if(!(n = q - p))
+			break;
+		if(n != 1 || p[0] != '.') {
+			if(len + 1 + n >= PATH_MAX)
+				return 0;
+			dst[len++] = DIR_SEP_CHAR;
+			memcpy(dst + len, p, n), len += n;
+		}
+		p = q;
+	}
+	if(!len)
+		dst[len++] = DIR_SEP_CHAR;
+	dst[len] = '\0';
+	return 1;
+}
+
+static int
+file_inside(const char *file_name)
+{
+	char path[PATH_MAX], *slash, *rp;
+	struct stat st;
+	int i;
+	/* ".." can climb out of a symlinked directory, only realpath knows */
+	if(!sandbox_len || strstr(file_name, "..") || !file_normalize(path, file_name))
+		return file_inside_resolved(file_name);
+	if(!strcmp(path, sandbox))
+		return 1;
+	if(!lstat(path, &st) && S_ISLNK(st.st_mode))
+		return file_inside_resolved(file_name);
+	slash = strrchr(path, DIR_SEP_CHAR);
+	*slash = '\0';
+	if(slash == path)
+		path[0] = DIR_SEP_CHAR, path[1] = '\0';
+	/* the directory must still resolve to the same inode as when it was checked */
+	if(stat(path, &st))
+		return file_inside_resolved(file_name);
+	for(i = 0; i < 0x10; i++)
+		if(sandbox_dirs[i].dev == st.st_dev && sandbox_dirs[i].ino == st.st_ino && !strcmp(sandbox_dirs[i].path, path))
+			return sandbox_dirs[i].inside;
+	if(!(rp = realpath(path, NULL)))
+		return file_inside_resolved(file_name);
+	i = sandbox_next++ & 0xf;
+	strcpy(sandbox_dirs[i].path, path);
+	sandbox_dirs[i].dev = st.st_dev, sandbox_dirs[i].ino = st.st_ino;
+	sandbox_dirs[i].inside = pathcmp(sandbox, rp, sandbox_len) == 0;
+	free(rp);
+	return sandbox_dirs[i].inside;
+}
+#else
+#define file_inside(file_name) file_inside_resolved(file_name)
+#endif
+
+static void
+file_check_sandbox(UxnFile *c)
+{
+	if(!file_inside(c->current_filename)) {
 		c->outside_sandbox = 1;
 		fprintf(stderr, "file warning: blocked attempt to access %s outside of sandbox\n", c->current_filename);
 	}
-	free(rp);
 }
 
 static Uint16
@@ -176,6 +342,7 @@ file_init(UxnFile *c, char *filename, size_t max_len, int override_sandbox)
 	char *p = c->current_filename;
 	size_t len = sizeof(c->current_filename);
 	reset(c);
+	c->seek = 0;
 	if(len > max_len) len = max_len;
 	while(len) {
 		if((*p++ = *filename++) == '\0') {
@@ -189,21 +356,135 @@ file_init(UxnFile *c, char *filename, size_t max_len, int override_sandbox)
 	return 0;
 }
 
+#ifndef _WIN32
+static Uint16
+file_read_ahead(UxnFile *c, Uint8 *dest, Uint16 len)
+{
+	Uint16 done = 0;
+	ssize_t n;
+	if(!c->ahead && !(c->ahead = (Uint8 *)malloc(FILE_AHEAD))) {
+		if((n = pread(fileno(c->f), dest, len, c->pos)) <= 0)
+			return 0;
+		c->pos += n;
+		return n;
+	}
+	/* one pread fills the buffer, small reads are served from it */
+	while(done < len) {
+		size_t avail;
+		if(c->pos < c->apos || c->pos >= c->apos + c->alen || c->ageneration != generation) {
+			if((n = pread(fileno(c->f), c->ahead, FILE_AHEAD, c->pos)) < 0 && errno == ESPIPE && !done)
+				return fread(dest, 1, len, c->f);
+			if(n <= 0)
+				break;
+			c->apos = c->pos, c->alen = n, c->ageneration = generation;
+		}
+		avail = c->apos + c->alen - c->pos;
+		if(avail > (size_t)(len - done))
+			avail = len - done;
+		memcpy(dest + done, c->ahead + (c->pos - c->apos), avail);
+		c->pos += avail, done += avail;
+	}
+	return done;
+}
+#endif
+
+static void
+file_watch(UxnFile *c)
+{
+#ifdef __linux__
+	char events[0x400];
+	if(c->notify < 0 && (c->notify = inotify_init()) >= 0)
+		fcntl(c->notify, F_SETFL, O_NONBLOCK);
+	if(c->notify < 0) return;
+	if(c->watch >= 0)
+		inotify_rm_watch(c->notify, c->watch);
+	while(read(c->notify, events, sizeof(events)) > 0)
+		continue;
+	c->watch = inotify_add_watch(c->notify, c->current_filename, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+	c->fresh = c->watch >= 0;
+#else
+	c->fresh = 0;
+#endif
+}
+
+static int
+file_cached(UxnFile *c)
+{
+#ifdef __linux__
+	char events[0x400];
+	if(!c->fresh || strcmp(c->listed, c->current_filename)) return 0;
+	while(read(c->notify, events, sizeof(events)) > 0)
+		c->fresh = 0;
+	return c->fresh;
+#else
+	(void)c;
+	return 0;
+#endif
+}
+
+static void
+file_list(UxnFile *c)
+{
+	Uint16 n;
+	file_watch(c);
+	c->llen = c->lpos = 0;
+	for(;;) {
+		if(c->lcap - c->llen < 0x1000) {
+			char *listing = realloc(c->listing, c->lcap + 0x1000 + c->lcap);
+			if(!listing) break;
+			c->listing = listing, c->lcap += 0x1000 + c->lcap;
+		}
+		if(!(n = file_read_dir(c, c->listing + c->llen, 0x1000)))
+			break;
+		c->llen += n;
+	}
+	closedir(c->dir);
+	c->dir = NULL;
+	strcpy(c->listed, c->current_filename);
+}
+
+static Uint16
+file_read_listing(UxnFile *c, char *dest, Uint16 len)
+{
+	size_t n = 0;
+	while(c->lpos + n < c->llen) {
+		char *line = c->listing + c->lpos + n, *nl = memchr(line, '\n', c->llen - c->lpos - n);
+		size_t size = nl ? (size_t)(nl - line) + 1 : c->llen - c->lpos - n;
+		if(n + size > len) break;
+		n += size;
+	}
+	memcpy(dest, c->listing + c->lpos, n);
+	c->lpos += n;
+	return n;
+}
+
 static Uint16
 file_read(UxnFile *c, void *dest, int len)
 {
 	if(c->outside_sandbox) return 0;
 	if(c->state != FILE_READ && c->state != DIR_READ) {
 		reset(c);
-		if((c->dir = opendir(c->current_filename)) != NULL)
-			c->state = DIR_READ;
+		file_flush_path(c->current_filename);
+		if(file_cached(c))
+			c->state = DIR_READ, c->lpos = 0;
+		else if((c->dir = opendir(c->current_filename)) != NULL)
+			c->state = DIR_READ, file_list(c);
 		else if((c->f = fopen(c->current_filename, "rb")) != NULL)
-			c->state = FILE_READ;
+			c->state = FILE_READ, c->pos = c->seek;
+	}
+	if(c->state == FILE_READ) {
+#ifndef _WIN32
+		return file_read_ahead(c, dest, len);
+#else
+		if(fseeko(c->f, c->pos, SEEK_SET))
+			return 0;
+		len = fread(dest, 1, len, c->f);
+		c->pos += len;
+		return len;
+#endif
 	}
-	if(c->state == FILE_READ)
-		return fread(dest, 1, len, c->f);
 	if(c->state == DIR_READ)
-		return file_read_dir(c, dest, len);
+		return file_read_listing(c, dest, len);
 	return 0;
 }
 
@@ -214,12 +495,25 @@ file_write(UxnFile *c, void *src, Uint16 len, Uint8 flags)
 	if(c->outside_sandbox) return 0;
 	if(c->state != FILE_WRITE) {
 		reset(c);
-		if((c->f = fopen(c->current_filename, (flags & 0x01) ? "ab" : "wb")) != NULL)
-			c->state = FILE_WRITE;
+		file_flush_path(c->current_filename);
+		/* writing at an offset keeps the rest of the file */
+		if(c->seek && !(flags & 0x01) && (c->f = fopen(c->current_filename, "r+b")) != NULL)
+			fseeko(c->f, c->seek, SEEK_SET);
+		else
+			c->f = fopen(c->current_filename, (flags & 0x01) ? "ab" : "wb");
+		if(c->f != NULL) {
+			c->state = FILE_WRITE, c->sync = flags & 0x02, c->error = 0;
+			setvbuf(c->f, NULL, _IOFBF, 0x10000);
+			c->next = writers, writers = c, generation++;
+		}
 	}
 	if(c->state == FILE_WRITE) {
-		if((ret = fwrite(src, 1, len, c->f)) > 0 && fflush(c->f) != 0)
-			ret = 0;
+		/* writes are buffered until close, a full buffer, an empty write,
+		 * a read of the same file or file_flush, a failed flush fails them */
+		if(!len)
+			ret = file_flush_handle(c);
+		else if(!c->error)
+			ret = fwrite(src, 1, len, c->f);
 	}
 	return ret;
 }
@@ -229,6 +523,7 @@ file_stat(UxnFile *c, void *dest, Uint16 len)
 {
 	char *basename = strrchr(c->current_filename, DIR_SEP_CHAR);
 	if(c->outside_sandbox) return 0;
+	file_flush_path(c->current_filename);
 	if(basename != NULL)
 		basename++;
 	else
@@ -242,20 +537,126 @@ file_delete(UxnFile *c)
 	return c->outside_sandbox ? 0 : unlink(c->current_filename);
 }
 
+static Uint32
+file_tell(UxnFile *c)
+{
+	if(c->state == FILE_READ)
+		return c->pos;
+	if(c->state == FILE_WRITE)
+		return ftello(c->f);
+	return c->seek;
+}
+
+static Uint32
+file_size(UxnFile *c)
+{
+	struct stat st;
+	if(c->outside_sandbox) return 0;
+	file_flush_path(c->current_filename);
+	if(stat(c->current_filename, &st) || !S_ISREG(st.st_mode))
+		return 0;
+	return st.st_size > 0xffffffff ? 0xffffffff : st.st_size;
+}
+
+static void
+file_seek(UxnFile *c, Uint32 offset)
+{
+	c->seek = offset;
+	if(c->state == FILE_READ)
+		c->pos = offset;
+	else if(c->state == FILE_WRITE)
+		fseeko(c->f, offset, SEEK_SET);
+}
+
 /* IO */
 
 void
-file_deo(Uint8 id, Uint8 *ram, Uint8 *d, Uint8 port)
+file_free(Varvara *prg)
+{
+	int i;
+	if(!prg->files) return;
+	for(i = 0; i < POLYFILEY; i++) {
+		UxnFile *c = &prg->files[i];
+		reset(c);
+		free(c->listing), free(c->ahead);
+		if(c->notify >= 0)
+			close(c->notify);
+	}
+	free(prg->files), prg->files = NULL;
+}
+
+void
+file_flush(Varvara *prg)
+{
+	int i;
+	if(!prg->files) return;
+	for(i = 0; i < POLYFILEY; i++)
+		file_flush_handle(&prg->files[i]);
+}
+
+int
+file_alloc(Varvara *prg)
+{
+	int i;
+	if(prg->files) return 1;
+	file_sandbox();
+	if(!(prg->files = (UxnFile *)calloc(POLYFILEY, sizeof(UxnFile))))
+		return 0;
+	for(i = 0; i < POLYFILEY; i++)
+		prg->files[i].notify = prg->files[i].watch = -1;
+	return 1;
+}
+
+Uint8
+file_dei(Varvara *prg, Uint8 id, Uint8 *s, Uint8 port)
+{
+	Uint32 v;
+	if(id >= POLYFILEY || !file_alloc(prg)) return s[port];
+	if(port == 0x0) {
+		v = file_tell(&prg->files[id]);
+		POKE2(s, v >> 16)
+		POKE2(s + 2, v)
+	} else if(port == 0x4) {
+		v = file_size(&prg->files[id]);
+		POKE2(s + 4, v >> 16)
+		POKE2(s + 6, v)
+	}
+	return s[port];
+}
+
+void
+file_offset(Varvara *prg, Uint8 id, Uint8 *s, Uint8 port)
+{
+	if(id >= POLYFILEY || port != 0x3 || !file_alloc(prg)) return;
+	file_seek(&prg->files[id], (Uint32)PEEK2(s) << 16 | PEEK2(s + 2));
+}
+
+Uint16
+file_io(Varvara *prg, Uint8 id, Uint8 port, void *buf, Uint16 len, Uint8 flags)
+{
+	UxnFile *c = &prg->files[id];
+	switch(port) {
+	case 0x5: return file_stat(c, buf, len);
+	case 0xd: return file_read(c, buf, len);
+	case 0xf: return file_write(c, buf, len, flags);
+	}
+	return 0;
+}
+
+void
+file_deo(Varvara *prg, Uint8 id, Uint8 *ram, Uint8 *d, Uint8 port)
 {
-	UxnFile *c = &uxn_file[id];
+	UxnFile *c;
 	Uint16 addr, len, res;
+	if(id >= POLYFILEY || !file_alloc(prg)) return;
+	c = &prg->files[id];
 	switch(port) {
 	case 0x5:
 		addr = PEEK2(d + 0x4);
 		len = PEEK2(d + 0xa);
 		if(len > 0x10000 - addr)
 			len = 0x10000 - addr;
-		res = file_stat(c, &ram[addr], len);
+		res = file_io(prg, id, port, &ram[addr], len, 0);
 		POKE2(d + 0x2, res);
 		break;
 	case 0x6:
@@ -272,7 +673,7 @@ file_deo(Uint8 id, Uint8 *ram, Uint8 *d, Uint8 port)
 		len = PEEK2(d + 0xa);
 		if(len > 0x10000 - addr)
 			len = 0x10000 - addr;
-		res = file_read(c, &ram[addr], len);
+		res = file_io(prg, id, port, &ram[addr], len, 0);
 		POKE2(d + 0x2, res);
 		break;
 	case 0xf:
@@ -280,7 +681,7 @@ file_deo(Uint8 id, Uint8 *ram, Uint8 *d, Uint8 port)
 		len = PEEK2(d + 0xa);
 		if(len > 0x10000 - addr)
 			len = 0x10000 - addr;
-		res = file_write(c, &ram[addr], len, d[0x7]);
+		res = file_io(prg, id, port, &ram[addr], len, d[0x7]);
 		POKE2(d + 0x2, res);
 		break;
 	}
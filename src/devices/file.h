@@ -13,7 +13,17 @@ WITH REGARD TO THIS SOFTWARE.
 #define FILE_DEIMASK 0x0000
 #define FILE_DEOMASK 0xa260
 
+#ifndef POLYFILEY
 #define POLYFILEY 2
+#endif
 #define DEV_FILE0 0xa
 
-void file_deo(Uint8 id, Uint8 *ram, Uint8 *d, Uint8 port);
+typedef struct UxnFile UxnFile;
+
+int file_alloc(Varvara *prg);
+void file_free(Varvara *prg);
+void file_flush(Varvara *prg);
+Uint8 file_dei(Varvara *prg, Uint8 id, Uint8 *s, Uint8 port);
+void file_offset(Varvara *prg, Uint8 id, Uint8 *s, Uint8 port);
+Uint16 file_io(Varvara *prg, Uint8 id, Uint8 port, void *buf, Uint16 len, Uint8 flags);
+void file_deo(Varvara *prg, Uint8 id, Uint8 *ram, Uint8 *d, Uint8 port);
@@ -1,13 +1,16 @@
 #include <SDL2/SDL.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "uxn.h"
 #include "devices/system.h"
 #include "devices/screen.h"
+#include "devices/console.h"
 #include "devices/controller.h"
 #include "devices/mouse.h"
 #include "devices/file.h"
 #include "devices/datetime.h"
+#include "devices/bridge.h"
 #include "roms/menu.c"
 #include "roms/wallpaper.c"
 #include "roms/potato.c"
@@ -25,51 +28,412 @@ WITH REGARD TO THIS SOFTWARE.
 
 /* clang-format off */
 
+#define WORKERS 0x10
+#define BAND 0x40
+#define DAMAGE 0x10
+#define GRID 0x20
+#define CELL 0x80
+#define TASKS 0x20
+#define QUEUE 0x1000
+#ifndef THROTTLE
+#define THROTTLE 0x10
+#endif
+
 enum Action { NORMAL, MOVE, DRAW };
 typedef struct { int x, y, mode; } Point2d;
+typedef struct { int x1, y1, x2, y2; } Rect2d;
+typedef struct { int w, h, level; Uint32 *pixels; } Thumb;
+typedef struct Task { void (*run)(struct Task *t), (*finish)(struct Task *t); int id, serial, soft, length; Uint8 dev, port, flags, *data; Uint16 addr; char path[0x40]; } Task;
+typedef struct { Uint32 head, tail, size, messages, bytes, drops, last, lost, rate; Uint8 stall, *type, *value, **data; } Queue;
 static Uint8 *ram, cursor_icn[] = {
 	0xfe, 0xfc, 0xf8, 0xf8, 0xfc, 0xce, 0x87, 0x02, 
 	0xff, 0xff, 0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 
 	0x18, 0x18, 0x18, 0xff, 0xff, 0x18, 0x18, 0x18};
-static Uint32 *pixels, palette[] = {0xeeeeee, 0x000000, 0x77ddcc, 0xffbb44};
-static int WIDTH, HEIGHT, reqdraw, olen;
-static Varvara varvaras[RAM_PAGES], *order[RAM_PAGES], *wallpaper, *menu, *focused, *potato;
-static Point2d camera, drag, cursor;
+static Uint16 hex_icn[] = {
+	0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7292,
+	0x7bef, 0x7bcf, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4};
+static Uint32 *pixels, *backdrop, palette[] = {0xeeeeee, 0x000000, 0x77ddcc, 0xffbb44};
+static int WIDTH, HEIGHT, PITCH, reqdraw, olen, dmlen, blen, wfirst, wlast, frames, indexed, zoom;
+static Varvara varvaras[RAM_PAGES], *order[RAM_PAGES], *locked[RAM_PAGES], *wallpaper, *menu, *focused, *potato;
+static Point2d camera, drag, cursor, origin;
+static Rect2d frame, stale, damage[DAMAGE];
 static enum Action action;
 static SDL_DisplayMode DM;
 static SDL_Window *gWindow = NULL;
 static SDL_Renderer *gRenderer = NULL;
 static SDL_Texture *gTexture = NULL;
+static SDL_PixelFormat *gFormat = NULL;
+static SDL_Cursor *gCursors[3];
+static SDL_Thread *gWorkers[WORKERS], *gLoader;
+static Thumb thumbs[RAM_PAGES];
+static Queue queues[RAM_PAGES][0x10];
+static Uint8 *banks[RAM_PAGES], sources[RAM_PAGES];
+static int serial, serials[RAM_PAGES], laid[RAM_PAGES], argn, epochs[RAM_PAGES], pending[RAM_PAGES][2];
+static Bridge bridges[RAM_PAGES];
 
 /* clang-format on */
 
+/* = WORKERS ===================================== */
+
+static int jobs, wlen;
+static void (*job)(int i);
+static SDL_atomic_t next;
+static SDL_sem *wake, *done;
+
+static void
+work_take(void)
+{
+	int i;
+	while((i = SDL_AtomicAdd(&next, 1)) < jobs)
+		job(i);
+}
+
+static int
+work_loop(void *data)
+{
+	(void)data;
+	for(;;) {
+		SDL_SemWait(wake);
+		if(!job) return 0;
+		work_take();
+		SDL_SemPost(done);
+	}
+}
+
+static void
+work_run(void (*fn)(int i), int count)
+{
+	int i, n = count - 1 < wlen ? count - 1 : wlen;
+	job = fn, jobs = count;
+	SDL_AtomicSet(&next, 0);
+	for(i = 0; i < n; i++)
+		SDL_SemPost(wake);
+	work_take();
+	for(i = 0; i < n; i++)
+		SDL_SemWait(done);
+}
+
+static void
+work_init(void)
+{
+	int i, n = SDL_GetCPUCount() - 1;
+	wake = SDL_CreateSemaphore(0), done = SDL_CreateSemaphore(0);
+	if(!wake || !done) return;
+	for(i = 0; i < n && i < WORKERS; i++, wlen++)
+		if(!(gWorkers[i] = SDL_CreateThread(work_loop, "worker", NULL)))
+			break;
+}
+
+static void
+work_end(void)
+{
+	int i;
+	job = NULL;
+	for(i = 0; i < wlen; i++)
+		SDL_SemPost(wake);
+	for(i = 0; i < wlen; i++)
+		SDL_WaitThread(gWorkers[i], NULL);
+	SDL_DestroySemaphore(wake), SDL_DestroySemaphore(done);
+	wlen = 0;
+}
+
+/* = LOADER ====================================== */
+
+static Task tasks[TASKS], *late;
+static int posted, ran, finished, *after, llen, lcap;
+static SDL_mutex *tlock, *fslock;
+static SDL_cond *tcond;
+static SDL_sem *twake;
+
+static int
+io_loop(void *data)
+{
+	Task *t;
+	(void)data;
+	for(;;) {
+		SDL_SemWait(twake);
+		SDL_LockMutex(tlock);
+		t = ran < posted ? &tasks[ran % TASKS] : NULL;
+		SDL_UnlockMutex(tlock);
+		if(!t) return 0;
+		t->run(t);
+		SDL_LockMutex(tlock);
+		ran++;
+		SDL_CondBroadcast(tcond);
+		SDL_UnlockMutex(tlock);
+	}
+}
+
+static Task *
+io_task(void)
+{
+	if(posted - finished >= TASKS) return NULL;
+	return &tasks[posted % TASKS];
+}
+
+static int
+io_post(Task *t)
+{
+	int seq;
+	if(!gLoader) { /* run it now, its completion still waits for io_poll */
+		t->run(t);
+		ran = seq = ++posted;
+		return seq;
+	}
+	SDL_LockMutex(tlock);
+	seq = ++posted;
+	SDL_UnlockMutex(tlock);
+	SDL_SemPost(twake);
+	return seq;
+}
+
+static void
+io_wait(int seq)
+{
+	if(!gLoader) return;
+	SDL_LockMutex(tlock);
+	while(ran < seq)
+		SDL_CondWait(tcond, tlock);
+	SDL_UnlockMutex(tlock);
+}
+
+static void
+io_poll(void)
+{
+	int n;
+	if(gLoader)
+		SDL_LockMutex(tlock);
+	n = ran;
+	if(gLoader)
+		SDL_UnlockMutex(tlock);
+	for(;; finished++) {
+		/* completions that ran outside the queue keep their place in it */
+		while(llen && after[0] <= finished) {
+			Task t = late[0];
+			memmove(late, late + 1, --llen * sizeof(Task)), memmove(after, after + 1, llen * sizeof(int));
+			t.finish(&t);
+		}
+		if(finished >= n) break;
+		tasks[finished % TASKS].finish(&tasks[finished % TASKS]);
+	}
+}
+
+static int
+io_defer(Task *t)
+{
+	if(llen == lcap) {
+		Task *l = (Task *)realloc(late, (lcap + 0x10) * sizeof(Task));
+		int *a = l ? (int *)realloc(after, (lcap + 0x10) * sizeof(int)) : NULL;
+		if(l) late = l;
+		if(!a) return 0;
+		after = a, lcap += 0x10;
+	}
+	late[llen] = *t, after[llen++] = posted;
+	return 1;
+}
+
+static void
+io_init(void)
+{
+	tlock = SDL_CreateMutex(), tcond = SDL_CreateCond(), twake = SDL_CreateSemaphore(0);
+	fslock = SDL_CreateMutex();
+	if(tlock && tcond && twake)
+		gLoader = SDL_CreateThread(io_loop, "loader", NULL);
+}
+
+static void
+io_end(void)
+{
+	if(gLoader)
+		SDL_SemPost(twake), SDL_WaitThread(gLoader, NULL), gLoader = NULL;
+	for(; finished < ran; finished++)
+		free(tasks[finished % TASKS].data), tasks[finished % TASKS].data = NULL;
+	free(late), free(after), late = NULL, after = NULL, llen = lcap = 0;
+	SDL_DestroyMutex(tlock), SDL_DestroyCond(tcond), SDL_DestroySemaphore(twake);
+	SDL_DestroyMutex(fslock);
+}
+
+static void
+io_flush(void)
+{
+	int i;
+	/* buffered writes reach their files once a frame, or the next one if
+	 * the loader is busy in the file device */
+	if(SDL_TryLockMutex(fslock)) return;
+	for(i = 0; i < RAM_PAGES; i++)
+		if(varvaras[i].live)
+			file_flush(&varvaras[i]);
+	SDL_UnlockMutex(fslock);
+}
+
 /* = DRAWING ===================================== */
 
+static Uint32
+map_color(Uint32 c)
+{
+	return SDL_MapRGB(gFormat, c >> 16, c >> 8, c);
+}
+
+static void
+map_palette(Uint32 *p)
+{
+	int i;
+	for(i = 0; i < 4; i++)
+		p[i] = map_color(p[i]);
+}
+
+static int
+get_floor(int v, int d)
+{
+	return v >= 0 ? v / d : -((-v + d - 1) / d);
+}
+
+static int
+get_scaled(int v)
+{
+	return zoom >= 0 ? v * (zoom + 1) : get_floor(v, 1 << -zoom);
+}
+
+static int
+get_unscaled(int v)
+{
+	return zoom >= 0 ? get_floor(v, zoom + 1) : v * (1 << -zoom);
+}
+
+static int
+get_length(int v)
+{
+	return zoom >= 0 ? v * (zoom + 1) : (v + (1 << -zoom) - 1) >> -zoom;
+}
+
 static void
-draw_pixel(unsigned int x, unsigned int y, Uint32 color)
+get_label(Rect2d *l, Rect2d *t)
 {
-	if(x < WIDTH && y < HEIGHT)
-		pixels[y * WIDTH + x] = color;
+	t->x1 = (l->x1 + l->x2) / 2 + 3, t->y1 = (l->y1 + l->y2) / 2 + 3;
+	t->x2 = t->x1 + 15, t->y2 = t->y1 + 5;
 }
 
 static void
-draw_icn(int x, int y, Uint8 *sprite, Uint32 color)
+get_rect(Varvara *p, Rect2d *r)
 {
-	int y2 = y + 8, h;
-	for(; y < y2; y++, sprite++)
-		for(h = 0; h < 8; h++)
-			if(*sprite << h & 0x80)
-				draw_pixel(x + h, y, color);
+	if(p->lock) {
+		r->x1 = p->x, r->y1 = p->y;
+		r->x2 = r->x1 + p->screen.w, r->y2 = r->y1 + p->screen.h;
+		return;
+	}
+	r->x1 = get_scaled(p->x) + camera.x, r->y1 = get_scaled(p->y) + camera.y;
+	r->x2 = r->x1 + get_length(p->screen.w), r->y2 = r->y1 + get_length(p->screen.h);
 }
 
 static void
-draw_line(int ax, int ay, int bx, int by, Uint32 color)
+get_line(Varvara *a, Varvara *b, Rect2d *l)
+{
+	Rect2d ra, rb;
+	get_rect(a, &ra), get_rect(b, &rb);
+	l->x1 = ra.x2 + 1, l->y1 = ra.y1 - 2;
+	l->x2 = rb.x1 - 2, l->y2 = rb.y2 + 1;
+	if(a->y < b->y)
+		l->y1 = ra.y2 + 1, l->y2 = rb.y1 - 2;
+}
+
+static void
+draw_damage(int x1, int y1, int x2, int y2)
+{
+	int i;
+	Rect2d *r;
+	if(x1 < 0) x1 = 0;
+	if(y1 < 0) y1 = 0;
+	if(x2 > WIDTH) x2 = WIDTH;
+	if(y2 > HEIGHT) y2 = HEIGHT;
+	if(x1 >= x2 || y1 >= y2) return;
+	for(i = 0; i < dmlen; i++) {
+		r = &damage[i];
+		if(x1 <= r->x2 && x2 >= r->x1 && y1 <= r->y2 && y2 >= r->y1) {
+			if(r->x1 < x1) x1 = r->x1;
+			if(r->y1 < y1) y1 = r->y1;
+			if(r->x2 > x2) x2 = r->x2;
+			if(r->y2 > y2) y2 = r->y2;
+			damage[i--] = damage[--dmlen];
+		}
+	}
+	if(dmlen == DAMAGE) {
+		for(i = 0; i < dmlen; i++) {
+			r = &damage[i];
+			if(r->x1 < x1) x1 = r->x1;
+			if(r->y1 < y1) y1 = r->y1;
+			if(r->x2 > x2) x2 = r->x2;
+			if(r->y2 > y2) y2 = r->y2;
+		}
+		dmlen = 0;
+	}
+	r = &damage[dmlen++];
+	r->x1 = x1, r->y1 = y1, r->x2 = x2, r->y2 = y2;
+}
+
+static void
+draw_stale(int x1, int y1, int x2, int y2)
+{
+	if(stale.x1 >= stale.x2)
+		stale.x1 = x1, stale.y1 = y1, stale.x2 = x2, stale.y2 = y2;
+	else {
+		if(x1 < stale.x1) stale.x1 = x1;
+		if(y1 < stale.y1) stale.y1 = y1;
+		if(x2 > stale.x2) stale.x2 = x2;
+		if(y2 > stale.y2) stale.y2 = y2;
+	}
+}
+
+static void
+draw_touch(Varvara *v)
+{
+	int i, j;
+	Rect2d r;
+	get_rect(v, &r);
+	if(v->lock)
+		draw_damage(r.x1, r.y1, r.x2, r.y2), draw_stale(r.x1, r.y1, r.x2, r.y2);
+	else
+		draw_damage(r.x1 - 2, r.y1 - 2, r.x2 + 2, r.y2 + 2);
+	for(i = 0; i < olen; i++) {
+		Varvara *a = order[i];
+		for(j = 0; j < a->clen; j++) {
+			Varvara *b = a->routes[j];
+			if((a == v || b == v) && b->live) {
+				get_line(a, b, &r);
+				draw_damage(
+					(r.x1 < r.x2 ? r.x1 : r.x2), (r.y1 < r.y2 ? r.y1 : r.y2),
+					(r.x1 > r.x2 ? r.x1 : r.x2) + 3, (r.y1 > r.y2 ? r.y1 : r.y2) + 3);
+				get_label(&r, &r);
+				draw_damage(r.x1, r.y1, r.x2, r.y2);
+			}
+		}
+	}
+}
+
+static void
+draw_pixel(Rect2d *clip, int x, int y, Uint32 color)
+{
+	if(x >= clip->x1 && x < clip->x2 && y >= clip->y1 && y < clip->y2)
+		pixels[(y - origin.y) * PITCH + x - origin.x] = color;
+}
+
+static void
+draw_cursor(void)
+{
+	static int shape = -1, shown = -1;
+	if(shape != (int)action)
+		SDL_SetCursor(gCursors[action]), shape = action;
+	if(shown != cursor.mode)
+		SDL_ShowCursor(cursor.mode), shown = cursor.mode;
+}
+
+static void
+draw_line(Rect2d *clip, int ax, int ay, int bx, int by, Uint32 color)
 {
 	int dx = abs(bx - ax), sx = ax < bx ? 1 : -1;
 	int dy = -abs(by - ay), sy = ay < by ? 1 : -1;
 	int err = dx + dy, e2;
 	for(;;) {
-		draw_pixel(ax, ay, color);
+		draw_pixel(clip, ax, ay, color);
 		if(ax == bx && ay == by) break;
 		e2 = 2 * err;
 		if(e2 >= dy) err += dy, ax += sx;
@@ -78,53 +442,291 @@ draw_line(int ax, int ay, int bx, int by, Uint32 color)
 }
 
 static void
-draw_borders(int x1, int y1, int x2, int y2, Uint32 color)
+draw_borders(Rect2d *clip, int x1, int y1, int x2, int y2, Uint32 color)
 {
 	int x, y;
 	for(y = y1 - 1; y < y2 + 1; y++) {
-		draw_pixel(x1 - 2, y, color), draw_pixel(x2, y, color);
-		draw_pixel(x1 - 1, y, color), draw_pixel(x2 + 1, y, color);
+		draw_pixel(clip, x1 - 2, y, color), draw_pixel(clip, x2, y, color);
+		draw_pixel(clip, x1 - 1, y, color), draw_pixel(clip, x2 + 1, y, color);
 	}
 	for(x = x1 - 2; x < x2 + 2; x++) {
-		draw_pixel(x, y1 - 2, color), draw_pixel(x, y2, color);
-		draw_pixel(x, y1 - 1, color), draw_pixel(x, y2 + 1, color);
+		draw_pixel(clip, x, y1 - 2, color), draw_pixel(clip, x, y2, color);
+		draw_pixel(clip, x, y1 - 1, color), draw_pixel(clip, x, y2 + 1, color);
+	}
+}
+
+static void
+draw_label(Rect2d *clip, int x, int y, Uint32 value, Uint32 color)
+{
+	int i, j;
+	if(value > 0xffff) value = 0xffff;
+	for(i = 0; i < 4; i++, x += 4) {
+		Uint16 icn = hex_icn[value >> (12 - i * 4) & 0xf];
+		for(j = 0; j < 15; j++)
+			if(icn >> (14 - j) & 1)
+				draw_pixel(clip, x + j % 3, y + j / 3, color);
 	}
 }
 
 static void
-draw_connections(Varvara *a, Uint32 color)
+draw_connections(Rect2d *clip, Varvara *a, Uint32 color)
 {
-	int i, x1, x2, y1, y2;
+	int i;
+	Rect2d l, t;
 	for(i = 0; i < a->clen; i++) {
 		Varvara *b = a->routes[i];
+		Queue *q = &queues[a->u.id][i];
 		if(b && b->live) {
-			x1 = a->x + 1 + camera.x + a->screen.w, y1 = a->y - 2 + camera.y;
-			x2 = b->x - 2 + camera.x, y2 = b->y + b->screen.h + 1 + camera.y;
-			if(a->y < b->y)
-				y1 = a->y + a->screen.h + 1 + camera.y, y2 = b->y - 2 + camera.y;
-			draw_line(x1, y1, x2, y2, color);
+			Uint32 c = q->stall ? map_color(palette[3]) : color;
+			get_line(a, b, &l);
+			draw_line(clip, l.x1, l.y1, l.x2, l.y2, c);
+			if(q->rate > 0xff)
+				draw_line(clip, l.x1 + 1, l.y1, l.x2 + 1, l.y2, c), draw_line(clip, l.x1, l.y1 + 1, l.x2, l.y2 + 1, c);
+			if(q->rate > 0xfff)
+				draw_line(clip, l.x1 + 1, l.y1 + 1, l.x2 + 1, l.y2 + 1, c);
+			if(q->messages)
+				get_label(&l, &t), draw_label(clip, t.x1, t.y1, q->rate, c);
 		}
 	}
 }
 
 static void
-draw_window(Varvara *p)
+draw_window(Rect2d *clip, Varvara *p)
 {
 	Uint32 color;
 	Screen *scr = &p->screen;
-	int x, y, row, relrow, x2, y2, w = scr->w, h = scr->h, x1 = p->x, y1 = p->y;
+	int y, w = scr->w, cx1, cy1, cx2, cy2;
+	Rect2d r;
+	get_rect(p, &r);
 	if(!p->lock) {
-		x1 += camera.x, y1 += camera.y, color = palette[(1 + action) & 0x3];
-		draw_borders(x1, y1, x1 + w, y1 + h, color);
-		if(p->clen) draw_connections(p, color);
+		color = map_color(palette[(1 + action) & 0x3]);
+		draw_borders(clip, r.x1, r.y1, r.x2, r.y2, color);
+		if(p->clen) draw_connections(clip, p, color);
+	}
+	cx1 = r.x1 > clip->x1 ? r.x1 : clip->x1, cx2 = r.x2 < clip->x2 ? r.x2 : clip->x2;
+	cy1 = r.y1 > clip->y1 ? r.y1 : clip->y1, cy2 = r.y2 < clip->y2 ? r.y2 : clip->y2;
+	if(cx1 >= cx2) return;
+	if(!p->lock && zoom < 0) {
+		Thumb *t = &thumbs[p->u.id];
+		if(!t->pixels || t->level != zoom) return;
+		for(y = cy1; y < cy2; y++)
+			memcpy(&pixels[(y - origin.y) * PITCH + cx1 - origin.x], &t->pixels[(y - r.y1) * t->w + cx1 - r.x1], (cx2 - cx1) * sizeof(Uint32));
+		return;
+	}
+	if(!p->lock && zoom > 0) {
+		int i, x, sx, n, z = zoom + 1;
+		Uint32 lut[16], *dst;
+		for(i = 0; i < 16; i++)
+			lut[i] = scr->palette[(i >> 2) ? (i >> 2) : (i & 3)];
+		for(y = cy1; y < cy2; y++) {
+			int row = (y - r.y1) / z * w;
+			dst = &pixels[(y - origin.y) * PITCH + cx1 - origin.x];
+			sx = (cx1 - r.x1) / z, n = z - (cx1 - r.x1) % z;
+			for(x = 0; x < cx2 - cx1; sx++, n = z) {
+				color = indexed ? lut[scr->fg[row + sx] << 2 | scr->bg[row + sx]] : scr->pixels[row + sx];
+				for(; n && x < cx2 - cx1; n--, x++)
+					dst[x] = color;
+			}
+		}
+		return;
 	}
-	x2 = x1 + w, y2 = y1 + h;
-	for(y = y1; y < y2; y++) {
-		row = y * WIDTH, relrow = (y - y1) * w;
-		for(x = x1; x < x2; x++)
-			if(x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
-				pixels[row + x] = scr->pixels[relrow + x - x1];
+	if(indexed) {
+		int i, x, len = cx2 - cx1;
+		Uint32 lut[16], *dst;
+		Uint8 *fg, *bg;
+		for(i = 0; i < 16; i++)
+			lut[i] = scr->palette[(i >> 2) ? (i >> 2) : (i & 3)];
+		for(y = cy1; y < cy2; y++) {
+			dst = &pixels[(y - origin.y) * PITCH + cx1 - origin.x];
+			fg = &scr->fg[(y - r.y1) * w + cx1 - r.x1], bg = &scr->bg[(y - r.y1) * w + cx1 - r.x1];
+			for(x = 0; x < len; x++)
+				dst[x] = lut[fg[x] << 2 | bg[x]];
+		}
+		return;
 	}
+	for(y = cy1; y < cy2; y++)
+		memcpy(&pixels[(y - origin.y) * PITCH + cx1 - origin.x], &scr->pixels[(y - r.y1) * w + cx1 - r.x1], (cx2 - cx1) * sizeof(Uint32));
+}
+
+static void
+draw_thumb(Varvara *v, int x1, int y1, int x2, int y2)
+{
+	Screen *scr = &v->screen;
+	Thumb *t = &thumbs[v->u.id];
+	int i, x, y, sx, sy, n, k = -zoom, size = 1 << k;
+	Uint32 lut[16], c, sum[4];
+	for(i = 0; i < 16; i++)
+		lut[i] = scr->palette[(i >> 2) ? (i >> 2) : (i & 3)];
+	x1 >>= k, y1 >>= k, x2 = (x2 + size - 1) >> k, y2 = (y2 + size - 1) >> k;
+	if(x2 > t->w) x2 = t->w;
+	if(y2 > t->h) y2 = t->h;
+	for(y = y1; y < y2; y++)
+		for(x = x1; x < x2; x++) {
+			sum[0] = sum[1] = sum[2] = sum[3] = 0, n = 0;
+			for(sy = y << k; sy < (y + 1) << k && sy < scr->h; sy++)
+				for(sx = x << k; sx < (x + 1) << k && sx < scr->w; sx++, n++) {
+					i = sy * scr->w + sx;
+					c = indexed ? lut[scr->fg[i] << 2 | scr->bg[i]] : scr->pixels[i];
+					sum[0] += c & 0xff, sum[1] += c >> 8 & 0xff, sum[2] += c >> 16 & 0xff, sum[3] += c >> 24;
+				}
+			if(n)
+				t->pixels[y * t->w + x] = sum[0] / n | (sum[1] / n) << 8 | (sum[2] / n) << 16 | (sum[3] / n) << 24;
+		}
+}
+
+static void
+draw_thumbs(void)
+{
+	int i;
+	for(i = 0; i < olen; i++) {
+		Varvara *v = order[i];
+		Thumb *t = &thumbs[v->u.id];
+		int w = get_length(v->screen.w), h = get_length(v->screen.h);
+		if(v->lock || (t->level == zoom && t->w == w && t->h == h))
+			continue;
+		if(t->w * t->h != w * h) {
+			Uint32 *buf = realloc(t->pixels, w * h * sizeof(Uint32));
+			if(!buf) continue;
+			t->pixels = buf;
+		}
+		t->w = w, t->h = h, t->level = zoom;
+		draw_thumb(v, 0, 0, v->screen.w, v->screen.h);
+	}
+}
+
+static Varvara *dirty[RAM_PAGES];
+
+static void
+draw_screen(int i)
+{
+	Varvara *v = dirty[i];
+	Screen *scr = &v->screen;
+	Thumb *t = &thumbs[v->u.id];
+	int x1 = scr->x1, y1 = scr->y1, x2 = scr->x2, y2 = scr->y2;
+	if(!indexed)
+		screen_redraw(scr);
+	else
+		scr->x1 = scr->y1 = 0xffff, scr->x2 = scr->y2 = 0;
+	if(zoom < 0 && !v->lock && t->level == zoom && t->w == get_length(scr->w) && t->h == get_length(scr->h))
+		draw_thumb(v, x1, y1, x2, y2);
+}
+
+static void
+draw_band(int band)
+{
+	int i, y;
+	Rect2d clip;
+	clip.x1 = frame.x1, clip.x2 = frame.x2;
+	clip.y1 = frame.y1 + band * BAND, clip.y2 = clip.y1 + BAND < frame.y2 ? clip.y1 + BAND : frame.y2;
+	if(wfirst)
+		for(y = clip.y1; y < clip.y2; y++)
+			memcpy(&pixels[(y - origin.y) * PITCH + clip.x1 - origin.x], &backdrop[y * WIDTH + clip.x1], (clip.x2 - clip.x1) * sizeof(Uint32));
+	for(i = wfirst; i < wlast; i++)
+		draw_window(&clip, order[i]);
+}
+
+static void
+draw_backdrop(void)
+{
+	int len;
+	for(len = 0; len < olen && order[len]->lock; len++)
+		if(locked[len] != order[len])
+			draw_stale(0, 0, WIDTH, HEIGHT), locked[len] = order[len];
+	if(len != blen)
+		draw_stale(0, 0, WIDTH, HEIGHT), blen = len;
+	if(stale.x1 < 0) stale.x1 = 0;
+	if(stale.y1 < 0) stale.y1 = 0;
+	if(stale.x2 > WIDTH) stale.x2 = WIDTH;
+	if(stale.y2 > HEIGHT) stale.y2 = HEIGHT;
+	if(stale.x1 < stale.x2 && stale.y1 < stale.y2) {
+		frame = stale, wfirst = 0, wlast = blen;
+		pixels = backdrop, PITCH = WIDTH, origin.x = origin.y = 0;
+		work_run(draw_band, (frame.y2 - frame.y1 + BAND - 1) / BAND);
+		draw_damage(stale.x1, stale.y1, stale.x2, stale.y2);
+	}
+	stale.x1 = stale.x2 = 0;
+}
+
+static void
+draw_frame(void)
+{
+	int i, pitch;
+	void *mem;
+	SDL_Rect r;
+	if(reqdraw)
+		dmlen = 0, draw_damage(0, 0, WIDTH, HEIGHT);
+	if(zoom < 0)
+		draw_thumbs();
+	draw_backdrop();
+	for(i = 0; i < dmlen; i++) {
+		frame = damage[i], wfirst = blen, wlast = olen;
+		r.x = frame.x1, r.y = frame.y1, r.w = frame.x2 - frame.x1, r.h = frame.y2 - frame.y1;
+		if(SDL_LockTexture(gTexture, &r, &mem, &pitch))
+			continue;
+		pixels = mem, PITCH = pitch >> 2, origin.x = r.x, origin.y = r.y;
+		work_run(draw_band, (r.h + BAND - 1) / BAND);
+		SDL_UnlockTexture(gTexture);
+	}
+	SDL_RenderCopy(gRenderer, gTexture, NULL, NULL);
+	SDL_RenderPresent(gRenderer);
+	reqdraw = dmlen = 0;
+}
+
+/* = INDEX ======================================= */
+
+static Uint32 grid[2][GRID * GRID];
+static Rect2d cells[RAM_PAGES];
+static Uint8 gridded[RAM_PAGES];
+
+static int
+grid_cell(int v)
+{
+	return v >= 0 ? v / CELL : -1 - (-1 - v) / CELL;
+}
+
+static void
+grid_mark(int g, Rect2d *c, Uint32 bit, int set)
+{
+	int x, y;
+	for(y = c->y1; y <= c->y2 && y < c->y1 + GRID; y++)
+		for(x = c->x1; x <= c->x2 && x < c->x1 + GRID; x++) {
+			Uint32 *m = &grid[g][(y & (GRID - 1)) * GRID + (x & (GRID - 1))];
+			*m = set ? *m | bit : *m & ~bit;
+		}
+}
+
+static Uint32
+grid_query(int g, int x1, int y1, int x2, int y2)
+{
+	int x, y, cx1 = grid_cell(x1), cy1 = grid_cell(y1), cx2 = grid_cell(x2 - 1), cy2 = grid_cell(y2 - 1);
+	Uint32 mask = 0;
+	for(y = cy1; y <= cy2 && y < cy1 + GRID; y++)
+		for(x = cx1; x <= cx2 && x < cx1 + GRID; x++)
+			mask |= grid[g][(y & (GRID - 1)) * GRID + (x & (GRID - 1))];
+	return mask;
+}
+
+static Uint32
+grid_area(int x1, int y1, int x2, int y2)
+{
+	int cx1 = get_unscaled(x1 - camera.x), cy1 = get_unscaled(y1 - camera.y);
+	int cx2 = get_unscaled(x2 - 1 - camera.x) + 1, cy2 = get_unscaled(y2 - 1 - camera.y) + 1;
+	return grid_query(0, cx1, cy1, cx2, cy2) | grid_query(1, x1, y1, x2, y2);
+}
+
+static void
+grid_update(Varvara *v)
+{
+	int id = v->u.id;
+	Uint32 bit = (Uint32)1 << id;
+	Rect2d c;
+	if(gridded[id])
+		grid_mark(gridded[id] - 1, &cells[id], bit, 0), gridded[id] = 0;
+	if(!v->live) return;
+	c.x1 = grid_cell(v->x - 2), c.y1 = grid_cell(v->y - 2);
+	c.x2 = grid_cell(v->x + v->screen.w + 1), c.y2 = grid_cell(v->y + v->screen.h + 1);
+	grid_mark(v->lock, &c, bit, 1);
+	cells[id] = c, gridded[id] = 1 + v->lock;
 }
 
 /* = OPTIONS ===================================== */
@@ -161,6 +763,7 @@ por_push(Varvara *p, int x, int y, int lock)
 	if(p) {
 		p->x = x, p->y = y, p->lock = lock, p->live = 1, reqdraw = 1;
 		order[olen++] = p;
+		grid_update(p);
 	}
 	return p;
 }
@@ -168,16 +771,27 @@ por_push(Varvara *p, int x, int y, int lock)
 static void
 por_pop(Varvara *p)
 {
+	int i;
 	if(!p) return;
-	p->clen = 0, p->live = 0, reqdraw = 1;
+	p->clen = 0, p->live = 0, reqdraw = 1, serials[p->u.id] = 0;
+	for(i = 0; i < RAM_PAGES; i++)
+		if(sources[i] == p->u.id + 1)
+			sources[i] = 0;
+	bridge_close(&bridges[p->u.id]);
+	io_wait(pending[p->u.id][0]), io_wait(pending[p->u.id][1]);
+	SDL_LockMutex(fslock), file_free(p), SDL_UnlockMutex(fslock);
+	epochs[p->u.id]++;
+	free(banks[p->u.id]), banks[p->u.id] = NULL;
 	por_raise(p);
 	olen--;
+	grid_update(p);
 }
 
 static Varvara *
 por_init(Varvara *v, int eval)
 {
 	screen_resize(&v->screen, 0x10, 0x10);
+	grid_update(v);
 	POKE2(&v->u.dev[0x22], WIDTH)
 	POKE2(&v->u.dev[0x24], HEIGHT)
 	if(eval)
@@ -186,28 +800,214 @@ por_init(Varvara *v, int eval)
 	return v;
 }
 
+static void
+por_placeholder(Varvara *v, int failed)
+{
+	Screen *scr = &v->screen;
+	int i;
+	for(i = 0; i < 4; i++)
+		scr->palette[i] = palette[i];
+	map_palette(scr->palette);
+	screen_fill(scr, scr->fg, 0), screen_fill(scr, scr->bg, 0);
+	for(i = 0; i < scr->w && i < scr->h; i++)
+		if(failed)
+			scr->fg[i * scr->w + i] = scr->fg[i * scr->w + scr->w - 1 - i] = 3;
+		else
+			scr->fg[i * scr->w + (i + 4) % scr->w] = scr->fg[i * scr->w + (i + 12) % scr->w] = 2;
+	screen_change(scr, 0, 0, scr->w, scr->h);
+	draw_touch(v);
+}
+
+static void
+por_layout(void)
+{
+	int i, anchor = 0x12;
+	for(i = 3; i < 3 + argn; i++) {
+		Varvara *v = &varvaras[i];
+		if(v->live && v->x == laid[i] && v->x != anchor)
+			draw_touch(v), v->x = anchor, grid_update(v), draw_touch(v);
+		if(v->live)
+			laid[i] = v->x, anchor += v->screen.w + 0x10;
+	}
+}
+
+static void
+por_read(Task *t)
+{
+	FILE *f = fopen(t->path, "rb");
+	t->length = -1;
+	if(!f) return;
+	if((t->data = (Uint8 *)malloc(0x10000 - PAGE_PROGRAM)))
+		t->length = fread(t->data, 1, 0x10000 - PAGE_PROGRAM, f);
+	fclose(f);
+}
+
+static void
+por_loaded(Task *t)
+{
+	Varvara *v = &varvaras[t->id];
+	if(serials[t->id] == t->serial) {
+		serials[t->id] = 0;
+		if(t->length < 0) {
+			system_error("Boot failed", t->path);
+			por_placeholder(v, 1);
+		} else {
+			Screen *scr = &v->screen;
+			draw_touch(v);
+			/* a rom that keeps the placeholder size must not keep its stripes */
+			screen_fill(scr, scr->fg, 0), screen_fill(scr, scr->bg, 0);
+			screen_change(scr, 0, 0, scr->w, scr->h);
+			system_boot_img(&v->u, t->data, t->length, t->soft);
+			por_init(v, 1);
+			draw_touch(v);
+			if(t->id >= 3 && t->id < 3 + argn)
+				por_layout();
+		}
+	}
+	free(t->data), t->data = NULL;
+}
+
+static void
+por_load(Varvara *v, int soft)
+{
+	Task sync, *t = io_task();
+	if(!t) t = &sync;
+	t->run = por_read, t->finish = por_loaded, t->data = NULL;
+	t->id = v->u.id, t->soft = soft, t->serial = serials[v->u.id] = ++serial;
+	SDL_strlcpy(t->path, v->rom, 0x40);
+	if(t == &sync)
+		por_read(t), por_loaded(t);
+	else
+		io_post(t);
+}
+
+static void
+por_fileio(Task *t)
+{
+	SDL_LockMutex(fslock);
+	t->length = file_io(&varvaras[t->id], t->dev, t->port, t->data, t->length, t->flags);
+	SDL_UnlockMutex(fslock);
+}
+
+static void
+por_filedone(Task *t)
+{
+	Varvara *v = &varvaras[t->id];
+	Uint8 *d = &v->u.dev[(DEV_FILE0 + t->dev) << 4];
+	if(t->serial == epochs[t->id] && v->live) {
+		if(t->port != 0xf && t->data)
+			memcpy(&v->u.ram[t->addr], t->data, t->length);
+		POKE2(d + 0x2, t->length)
+		if(PEEK2(d))
+			uxn_eval(&v->u, PEEK2(d));
+	}
+	free(t->data), t->data = NULL;
+}
+
+static void
+por_file(Varvara *v, Uint8 dev, Uint8 *d, Uint8 port)
+{
+	int id = v->u.id, async = PEEK2(d) && (port == 0x5 || port == 0xd || port == 0xf);
+	Task *t, sync;
+	if(port != 0x5 && port != 0x6 && port != 0x9 && port != 0xd && port != 0xf)
+		return;
+	/* the loader runs requests in order, only the synchronous ones wait */
+	if(async && file_alloc(v) && (t = io_task())) {
+		Uint16 addr = PEEK2(d + (port == 0x5 ? 0x4 : port == 0xd ? 0xc : 0xe)), len = PEEK2(d + 0xa);
+		if(len > 0x10000 - addr)
+			len = 0x10000 - addr;
+		if((t->data = (Uint8 *)malloc(len ? len : 1))) {
+			t->run = por_fileio, t->finish = por_filedone;
+			t->id = id, t->serial = epochs[id], t->dev = dev, t->port = port;
+			t->addr = addr, t->length = len, t->flags = d[0x7];
+			if(port == 0xf)
+				memcpy(t->data, &v->u.ram[addr], len);
+			pending[id][dev] = io_post(t);
+			return;
+		}
+	}
+	io_wait(pending[id][dev]);
+	SDL_LockMutex(fslock);
+	file_deo(v, dev, v->u.ram, d, port);
+	SDL_UnlockMutex(fslock);
+	/* the queue was full, the vector is still called once */
+	if(async) {
+		sync.finish = por_filedone, sync.data = NULL;
+		sync.id = id, sync.serial = epochs[id], sync.dev = dev, sync.port = port;
+		sync.length = PEEK2(d + 0x2);
+		io_defer(&sync);
+	}
+}
+
+static void
+por_bridge(Varvara *v)
+{
+	Bridge *b = &bridges[v->u.id];
+	bridge_close(b);
+	if(!bridge_open(b, v->rom))
+		system_error("Bridge failed", v->rom);
+	por_placeholder(v, !b->live);
+}
+
 static Varvara *
-por_spawn(int id, char *rom, int eval)
+por_spawn(int id, char *rom)
 {
 	Varvara *v;
 	if(id == -1 || id > RAM_PAGES) return 0;
 	v = &varvaras[id];
-	v->u.id = id, v->u.ram = ram + id * 0x10000;
-	system_boot_rom(v, &v->u, rom, 0);
-	return por_init(v, eval);
+	v->u.id = id, v->u.ram = ram + id * 0x10000, v->force = 0;
+	system_boot_img(&v->u, NULL, 0, 0);
+	SDL_strlcpy(v->rom, rom, 0x40);
+	por_init(v, 0);
+	por_placeholder(v, 0);
+	if(bridge_spec(rom))
+		por_bridge(v);
+	else
+		por_load(v, 0);
+	return v;
 }
 
 static Varvara *
-por_prefab(int id, Uint8 *rom, int length, int eval)
+por_prefab(int id, Uint8 *rom, int length, int eval, int soft)
 {
 	Varvara *v;
 	if(id == -1 || id > RAM_PAGES) return 0;
 	v = &varvaras[id];
 	v->u.id = id, v->u.ram = ram + id * 0x10000;
-	system_boot_img(&v->u, rom, length, 0);
+	system_boot_img(&v->u, rom, length, soft);
 	return por_init(v, eval);
 }
 
+static Uint8 *
+por_bank(Varvara *v, Uint16 page)
+{
+	int id = v->u.id, src = sources[id];
+	switch(page) {
+	case 0: return v->u.ram;
+	case 1:
+		if(!banks[id])
+			banks[id] = (Uint8 *)calloc(0x10000, 1);
+		return banks[id];
+	case 2: return src && varvaras[src - 1].live ? banks[src - 1] : NULL;
+	}
+	return NULL;
+}
+
+static void
+por_expand(Varvara *v)
+{
+	Uint8 *mem = v->u.ram, *a, *b;
+	Uint16 i, addr = PEEK2(&v->u.dev[0x02]);
+	if(mem[addr] == 0x1) {
+		Uint16 length = PEEK2(mem + addr + 1);
+		Uint16 a_addr = PEEK2(mem + addr + 1 + 4), b_addr = PEEK2(mem + addr + 1 + 8);
+		a = por_bank(v, PEEK2(mem + addr + 1 + 2)), b = por_bank(v, PEEK2(mem + addr + 1 + 6));
+		if(!a || !b) return;
+		for(i = 0; i < length; i++)
+			b[(Uint16)(b_addr + i)] = a[(Uint16)(a_addr + i)];
+	}
+}
+
 static int
 por_alloc(void)
 {
@@ -223,19 +1023,19 @@ por_alloc(void)
 static int
 por_within(Varvara *p, int x, int y)
 {
-	Screen *s = &p->screen;
-	int x1 = p->x, y1 = p->y;
-	if(p->lock)
-		x1 -= camera.x, y1 -= camera.y;
-	return p->live && x > x1 && x < x1 + s->w && y > y1 && y < y1 + s->h;
+	Rect2d r;
+	get_rect(p, &r);
+	return p->live && x > r.x1 && x < r.x2 && y > r.y1 && y < r.y2;
 }
 
 static Varvara *
 por_pick(int x, int y, int force)
 {
 	int i;
+	Uint32 mask = grid_area(x, y, x + 1, y + 1);
 	for(i = olen - 1; i > -1; --i) {
 		Varvara *p = order[i];
+		if(!(mask >> p->u.id & 1)) continue;
 		if((!p->lock || force) && por_within(p, x, y))
 			return p;
 	}
@@ -246,8 +1046,10 @@ static void
 por_pickfocus(int x, int y)
 {
 	int i;
+	Uint32 mask = grid_area(x, y, x + 1, y + 1);
 	for(i = olen - 1; i > -1; --i) {
 		Varvara *p = order[i];
+		if(!(mask >> p->u.id & 1)) continue;
 		if(por_within(p, x, y) && (!p->lock || p == potato)) {
 			por_focus(p);
 			return;
@@ -256,10 +1058,46 @@ por_pickfocus(int x, int y)
 	por_focus(0);
 }
 
+static int
+por_visible(int i, Uint32 shown)
+{
+	int j;
+	Uint32 mask;
+	Rect2d r, o;
+	if(!(shown >> order[i]->u.id & 1)) return 0;
+	get_rect(order[i], &r);
+	if(r.x1 < 0) r.x1 = 0;
+	if(r.y1 < 0) r.y1 = 0;
+	if(r.x2 > WIDTH) r.x2 = WIDTH;
+	if(r.y2 > HEIGHT) r.y2 = HEIGHT;
+	if(r.x1 >= r.x2 || r.y1 >= r.y2) return 0;
+	mask = grid_area(r.x1, r.y1, r.x2, r.y2);
+	for(j = i + 1; j < olen; j++) {
+		if(!(mask >> order[j]->u.id & 1)) continue;
+		get_rect(order[j], &o);
+		if(o.x1 <= r.x1 && o.y1 <= r.y1 && o.x2 >= r.x2 && o.y2 >= r.y2)
+			return 0;
+	}
+	return 1;
+}
+
+static int
+por_awake(int i, Uint32 shown)
+{
+	Varvara *v = order[i];
+	Uint8 rate = v->u.dev[0x27];
+	if(v == focused || v->force || por_visible(i, shown))
+		return 1;
+	if(rate == 0xff)
+		return 0;
+	return (frames + v->u.id) % (rate ? rate : THROTTLE) == 0;
+}
+
 static void
 por_connect(Varvara *a, Varvara *b)
 {
 	int i;
+	Queue *q;
 	if(a && b && a != b) {
 		reqdraw = 1;
 		for(i = 0; i < a->clen; i++)
@@ -267,6 +1105,11 @@ por_connect(Varvara *a, Varvara *b)
 				a->clen = 0;
 				return;
 			}
+		q = &queues[a->u.id][a->clen];
+		/* the ring is kept for the next route */
+		for(; q->head != q->tail; q->tail++)
+			free(q->data[q->tail & (q->size - 1)]);
+		q->head = q->tail = q->messages = q->bytes = q->drops = q->last = q->lost = q->rate = 0, q->stall = 0;
 		a->routes[a->clen++] = b;
 	}
 }
@@ -274,10 +1117,44 @@ por_connect(Varvara *a, Varvara *b)
 static void
 por_restart(Varvara *v, int soft)
 {
-	if(v) {
-		system_boot_rom(v, &v->u, v->rom, soft);
-		por_init(v, 1);
-	}
+	if(!v) return;
+	/* file requests of the previous program must not land in the new one */
+	io_wait(pending[v->u.id][0]), io_wait(pending[v->u.id][1]);
+	SDL_LockMutex(fslock), file_free(v), SDL_UnlockMutex(fslock);
+	epochs[v->u.id]++;
+	/* prefabs have no rom on disk, boot them from their images */
+	draw_touch(v);
+	if(v == menu)
+		por_prefab(0, menu_rom, sizeof(menu_rom), 0, soft);
+	else if(v == wallpaper)
+		por_prefab(1, wallpaper_rom, sizeof(wallpaper_rom), 1, soft);
+	else if(v == potato)
+		por_prefab(2, potato_rom, sizeof(potato_rom), 1, soft);
+	else if(bridge_spec(v->rom))
+		por_bridge(v);
+	else
+		por_load(v, soft);
+	draw_touch(v);
+}
+
+static void
+por_move(Varvara *v, int dx, int dy)
+{
+	draw_touch(v);
+	v->x += dx, v->y += dy;
+	grid_update(v);
+	draw_touch(v);
+}
+
+static void
+por_pan(int dx, int dy)
+{
+	int i;
+	for(i = 0; i < olen; i++)
+		if(!order[i]->lock) draw_touch(order[i]);
+	camera.x += dx, camera.y += dy;
+	for(i = 0; i < olen; i++)
+		if(!order[i]->lock) draw_touch(order[i]);
 }
 
 static void
@@ -286,11 +1163,12 @@ por_lock(Varvara *v)
 	if(!v || v == wallpaper || v == menu) return;
 	if(!v->lock) {
 		v->lock = 1, focused = 0;
-		v->x += camera.x, v->y += camera.y;
+		v->x = get_scaled(v->x) + camera.x, v->y = get_scaled(v->y) + camera.y;
 	} else {
 		v->lock = 0;
-		v->x -= camera.x, v->y -= camera.y;
+		v->x = get_unscaled(v->x - camera.x), v->y = get_unscaled(v->y - camera.y);
 	}
+	grid_update(v);
 	mouse_move(&v->u, &v->u.dev[0x90], 0x8000, 0x8000);
 	reqdraw = 1;
 }
@@ -299,11 +1177,29 @@ static void
 por_center(Varvara *v)
 {
 	if(!v || v->lock) return;
-	v->x = -camera.x + WIDTH / 2 - v->screen.w / 2;
-	v->y = -camera.y + HEIGHT / 2 - v->screen.h / 2;
+	v->x = get_unscaled(WIDTH / 2 - camera.x) - v->screen.w / 2;
+	v->y = get_unscaled(HEIGHT / 2 - camera.y) - v->screen.h / 2;
+	grid_update(v);
+	reqdraw = 1;
+}
+
+static void
+por_zoom(int level)
+{
+	int x, y;
+	if(level < -2 || level > 2) return;
+	x = get_unscaled(WIDTH / 2 - camera.x), y = get_unscaled(HEIGHT / 2 - camera.y);
+	zoom = level;
+	camera.x = WIDTH / 2 - get_scaled(x), camera.y = HEIGHT / 2 - get_scaled(y);
 	reqdraw = 1;
 }
 
+static void
+por_force(Varvara *v)
+{
+	if(v) v->force = !v->force;
+}
+
 static void
 por_close(Varvara *v)
 {
@@ -332,6 +1228,22 @@ por_menu(int x, int y)
 	por_push(menu, x, y, 0);
 }
 
+static void
+load_cursors(void)
+{
+	int i, x, y;
+	for(i = 0; i < 3; i++) {
+		SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, 8, 8, 32, SDL_PIXELFORMAT_ARGB8888);
+		if(!s) continue;
+		for(y = 0; y < 8; y++)
+			for(x = 0; x < 8; x++)
+				((Uint32 *)s->pixels)[y * (s->pitch >> 2) + x] = cursor_icn[i * 8 + y] << x & 0x80 ? 0xff000000 | palette[1 + i] : 0;
+		if(gCursors[i]) SDL_FreeCursor(gCursors[i]);
+		gCursors[i] = SDL_CreateColorCursor(s, 0, 0);
+		SDL_FreeSurface(s);
+	}
+}
+
 static void
 load_theme(void)
 {
@@ -354,11 +1266,9 @@ send_cmd(Varvara *dest, char c)
 {
 	int i;
 	if(c < 0x20) {
-		focused = por_push(por_spawn(por_alloc(), cmd, 0), menu->x, menu->y, 0);
+		focused = por_push(por_spawn(por_alloc(), cmd), menu->x, menu->y, 0);
 		for(i = 0; i < menu->clen; i++)
 			por_connect(focused, menu->routes[i]);
-		if(focused)
-			uxn_eval(&focused->u, PAGE_PROGRAM);
 		cmdlen = 0;
 		return;
 	}
@@ -369,20 +1279,22 @@ send_cmd(Varvara *dest, char c)
 	cmd[cmdlen++] = c, cmd[cmdlen] = 0;
 }
 
-void
+int
 send_msg(Varvara *dest, Uint8 type, Uint8 value)
 {
 	Uint8 *address;
 	Uint16 vector;
 	if(type == 0xff) {
 		send_cmd(dest, value);
-		return;
+		return 1;
 	}
 	if(type == 0xfe) {
 		por_setaction(value);
-		return;
+		return 1;
 	}
-	if(dest) {
+	if(dest && bridges[dest->u.id].live)
+		return bridge_write(&bridges[dest->u.id], value);
+	else if(dest) {
 		address = &dest->u.dev[0x10];
 		vector = PEEK2(address);
 		dest->u.dev[0x12] = value;
@@ -390,6 +1302,263 @@ send_msg(Varvara *dest, Uint8 type, Uint8 value)
 		if(vector)
 			uxn_eval(&dest->u, vector);
 	}
+	return 1;
+}
+
+/* = ROUTES ====================================== */
+
+static int
+route_room(Queue *q)
+{
+	Uint32 depth = q->head - q->tail;
+	return depth < QUEUE ? QUEUE - depth : 0;
+}
+
+static int
+route_held(Varvara *a)
+{
+	int r;
+	for(r = 0; r < a->clen; r++)
+		if(!route_room(&queues[a->u.id][r]))
+			return 1;
+	return 0;
+}
+
+static int
+route_grow(Queue *q)
+{
+	Uint32 i, size = q->size ? q->size * 2 : QUEUE;
+	Uint8 *type = (Uint8 *)malloc(size), *value = (Uint8 *)malloc(size), **data = (Uint8 **)malloc(size * sizeof(Uint8 *));
+	if(!type || !value || !data) {
+		free(type), free(value), free(data);
+		return 0;
+	}
+	for(i = 0; i < q->head - q->tail; i++) {
+		Uint32 j = (q->tail + i) & (q->size - 1);
+		type[i] = q->type[j], value[i] = q->value[j], data[i] = q->data[j];
+	}
+	free(q->type), free(q->value), free(q->data);
+	q->type = type, q->value = value, q->data = data, q->head -= q->tail, q->tail = 0, q->size = size;
+	return 1;
+}
+
+static int
+route_transfer(Varvara *b, Uint8 *data)
+{
+	Uint8 *d = &b->u.dev[0x10];
+	Uint16 len = PEEK2(data), pos = PEEK2(data + 2), dest = PEEK2(d + 0xa), n = len;
+	Bridge *br = &bridges[b->u.id];
+	if(br->live) {
+		for(; pos < len && bridge_write(br, data[4 + pos]); pos++)
+			continue;
+		POKE2(data + 2, pos)
+		return pos == len;
+	}
+	if(!dest)
+		return -1;
+	if(n > 0x10000 - dest)
+		n = 0x10000 - dest;
+	memcpy(&b->u.ram[dest], data + 4, n);
+	POKE2(d + 0xc, n)
+	d[0x2] = 0, d[0x7] = CONSOLE_BULK;
+	if(PEEK2(d))
+		uxn_eval(&b->u, PEEK2(d));
+	return 1;
+}
+
+static int
+route_deliver(Varvara *a, int r)
+{
+	Queue *q = &queues[a->u.id][r];
+	Varvara *b = a->routes[r];
+	Bridge *br = &bridges[b->u.id];
+	Uint32 i = q->tail & (q->size - 1);
+	Uint8 type = q->type[i], value = q->value[i], *data = q->data[i];
+	int sent = 1;
+	if(br->live && br->olen == BRIDGE_BUFFER && (bridge_flush(br), br->olen == BRIDGE_BUFFER))
+		return 0; /* stays queued until the bridge takes it */
+	if(!b->live || (!br->live && bridge_spec(b->rom)) || (br->live && br->wfd < 0))
+		sent = -1;
+	else if(data)
+		sent = route_transfer(b, data);
+	else
+		send_msg(b, type, value);
+	if(!sent)
+		return 0;
+	if(sent < 0)
+		q->drops++;
+	q->tail++, q->data[i] = NULL;
+	free(data);
+	return 1;
+}
+
+static int
+route_push(Queue *q, Uint8 type, Uint8 value, Uint8 *data)
+{
+	/* nothing is lost, a sender with a full queue waits for its next frame */
+	if(q->head - q->tail == q->size && !route_grow(q)) {
+		q->drops++;
+		return 0;
+	}
+	q->type[q->head & (q->size - 1)] = type, q->value[q->head & (q->size - 1)] = value;
+	q->data[q->head & (q->size - 1)] = data, q->head++;
+	q->messages++;
+	return 1;
+}
+
+static int
+route_send(Varvara *a, int r, Uint8 type, Uint8 value)
+{
+	Queue *q = &queues[a->u.id][r];
+	if(!route_push(q, type, value, NULL))
+		return 0;
+	q->bytes++;
+	return 1;
+}
+
+static void
+route_bulk(Varvara *a, Uint16 addr, Uint16 len)
+{
+	int r;
+	if(len > 0x10000 - addr)
+		len = 0x10000 - addr;
+	/* a snapshot of the range is queued in order with the bytes */
+	for(r = 0; r < a->clen; r++) {
+		Queue *q = &queues[a->u.id][r];
+		Uint8 *data = (Uint8 *)malloc(4 + len);
+		if(!data) {
+			q->drops++;
+			continue;
+		}
+		POKE2(data, len)
+		POKE2(data + 2, 0)
+		memcpy(data + 4, &a->u.ram[addr], len);
+		if(route_push(q, CONSOLE_BULK, 0, data))
+			q->bytes += len;
+		else
+			free(data);
+	}
+}
+
+static void
+route_inbox(Varvara *b)
+{
+	int i, r;
+	for(i = 0; i < RAM_PAGES; i++) {
+		Varvara *a = &varvaras[i];
+		for(r = 0; r < a->clen; r++) {
+			Queue *q = &queues[i][r];
+			Uint32 len = q->head - q->tail;
+			if(a->routes[r] != b) continue;
+			for(; len && r < a->clen && q->head != q->tail; len--)
+				if(!route_deliver(a, r))
+					break;
+		}
+	}
+}
+
+static void
+route_tally(void)
+{
+	int i, r;
+	for(i = 0; i < olen; i++) {
+		Varvara *a = order[i];
+		for(r = 0; r < a->clen; r++) {
+			Queue *q = &queues[a->u.id][r];
+			Uint32 rate = q->bytes - q->last;
+			Uint8 stall = q->drops != q->lost || !route_room(q);
+			if(rate != q->rate || stall != q->stall)
+				draw_touch(a);
+			q->rate = rate, q->last = q->bytes, q->stall = stall, q->lost = q->drops;
+		}
+	}
+}
+
+static Uint16
+route_stat(Varvara *a, Uint8 value)
+{
+	Queue *q = &queues[a->u.id][value >> 4];
+	Uint32 n = 0;
+	if((value >> 4) >= a->clen)
+		return 0;
+	switch(value & 0xf) {
+	case 0x0: n = q->messages; break;
+	case 0x1: n = q->bytes; break;
+	case 0x2: n = q->drops; break;
+	case 0x3: n = q->head - q->tail; break;
+	case 0x4: n = q->rate; break;
+	case 0x5: n = route_room(q); break;
+	}
+	return n > 0xffff ? 0xffff : n;
+}
+
+static void
+route_bridges(void)
+{
+	int i, r, n, total, count = 0;
+	Bridge *list[RAM_PAGES];
+	Uint8 buf[0x1000];
+	for(i = 0; i < RAM_PAGES; i++)
+		if(bridges[i].live && varvaras[i].live)
+			bridge_flush(&bridges[i]), list[count++] = &bridges[i];
+	if(!count) return;
+	bridge_poll(list, count);
+	for(i = 0; i < RAM_PAGES; i++) {
+		Varvara *a = &varvaras[i];
+		if(!bridges[i].live || !a->live || !a->clen) continue;
+		/* drain until the bridge would block, a frame's worth at most */
+		for(n = total = 0; total < 0x10000 && a->live; total += n) {
+			int room = sizeof(buf);
+			for(r = 0; r < a->clen; r++) {
+				Queue *q = &queues[i][r];
+				/* no sender is running here, the receivers can take it now */
+				if(route_room(q) < room)
+					while(q->head != q->tail && r < a->clen && route_deliver(a, r))
+						continue;
+				if(route_room(q) < room)
+					room = route_room(q);
+			}
+			if(!room || (n = bridge_read(&bridges[i], buf, room)) <= 0)
+				break;
+			for(r = 0; r < a->clen; r++) {
+				int j;
+				for(j = 0; j < n; j++)
+					route_send(a, r, CONSOLE_STD, buf[j]);
+			}
+		}
+		if(n < 0)
+			por_placeholder(a, 1);
+	}
+}
+
+static int
+route_schedule(Varvara **sched)
+{
+	int i, j, r, len = 0, head = 0, rank[RAM_PAGES], deg[RAM_PAGES], seen[RAM_PAGES];
+	for(i = 0; i < RAM_PAGES; i++)
+		rank[i] = -1;
+	for(i = 0; i < olen; i++)
+		rank[order[i]->u.id] = i, deg[i] = seen[i] = 0;
+	for(i = 0; i < olen; i++)
+		for(r = 0; r < order[i]->clen; r++)
+			if((j = rank[order[i]->routes[r]->u.id]) >= 0)
+				deg[j]++;
+	for(i = 0; i < olen; i++)
+		if(!deg[i])
+			sched[len++] = order[i], seen[i] = 1;
+	for(;;) {
+		for(; head < len; head++)
+			for(r = 0; r < sched[head]->clen; r++)
+				if((j = rank[sched[head]->routes[r]->u.id]) >= 0 && !seen[j] && !--deg[j])
+					sched[len++] = order[j], seen[j] = 1;
+		if(len == olen)
+			return len;
+		/* break the cycle, its remaining edges wait for the next frame */
+		i = 0;
+		while(seen[i])
+			i++;
+		sched[len++] = order[i], seen[i] = 1;
+	}
 }
 
 /* = MOUSE ======================================= */
@@ -398,35 +1567,38 @@ static void
 on_mouse_move(int x, int y)
 {
 	Uxn *u;
-	int relx = x - camera.x, rely = y - camera.y;
-	cursor.x = x, cursor.y = y, cursor.mode = 1, reqdraw = 1;
+	Rect2d r;
+	cursor.x = x, cursor.y = y, cursor.mode = 1;
 	if(focused == potato) {
 		mouse_move(&potato->u, &potato->u.dev[0x90], x - potato->x, y - potato->y);
 		cursor.mode = 0;
-		por_pickfocus(relx, rely);
+		por_pickfocus(x, y);
 		return;
 	} else if(action == DRAW)
 		return;
 	if(!drag.mode)
-		por_pickfocus(relx, rely);
+		por_pickfocus(x, y);
 	if(!focused) {
 		if(drag.mode) {
-			camera.x += x - drag.x, camera.y += y - drag.y;
+			por_pan(x - drag.x, y - drag.y);
 			drag.x = x, drag.y = y;
 		}
 		return;
 	}
 	if(action) {
 		if(drag.mode) {
-			focused->x += x - drag.x, focused->y += y - drag.y;
-			drag.x = x, drag.y = y;
+			int dx = get_unscaled(x - drag.x), dy = get_unscaled(y - drag.y);
+			por_move(focused, dx, dy);
+			drag.x += get_scaled(dx), drag.y += get_scaled(dy);
 		}
 		return;
 	}
 	u = &focused->u;
+	get_rect(focused, &r);
 	if(focused->lock)
-		relx = x, rely = y;
-	mouse_move(u, &u->dev[0x90], relx - focused->x, rely - focused->y);
+		mouse_move(u, &u->dev[0x90], x - r.x1, y - r.y1);
+	else
+		mouse_move(u, &u->dev[0x90], get_unscaled(x - r.x1), get_unscaled(y - r.y1));
 	if(PEEK2(&u->dev[0x90])) /* draw mouse when no mouse vector */
 		cursor.mode = 0;
 }
@@ -440,7 +1612,7 @@ on_mouse_down(int button, int x, int y)
 			if(action)
 				por_setaction(NORMAL);
 			else
-				por_menu(x - camera.x, y - camera.y);
+				por_menu(get_unscaled(x - camera.x), get_unscaled(y - camera.y));
 			return;
 		}
 		drag.mode = 1, drag.x = x, drag.y = y;
@@ -457,8 +1629,8 @@ on_mouse_up(int button, int x, int y)
 	Uxn *u;
 	if((!focused || action) && focused != potato) {
 		if(action == DRAW) {
-			Varvara *a = por_pick(drag.x - camera.x, drag.y - camera.y, 0);
-			Varvara *b = por_pick(x - camera.x, y - camera.y, 0);
+			Varvara *a = por_pick(drag.x, drag.y, 0);
+			Varvara *b = por_pick(x, y, 0);
 			por_connect(a, b);
 		}
 		drag.mode = 0;
@@ -473,13 +1645,44 @@ on_mouse_wheel(int x, int y)
 {
 	Uxn *u;
 	if(!focused) {
-		camera.x += x << 4, camera.y -= y << 4, reqdraw = 1;
+		por_pan(x << 4, -y << 4);
 		return;
 	}
 	u = &focused->u;
 	mouse_scroll(u, &u->dev[0x90], x, y);
 }
 
+/* Motion and wheel are coalesced per frame, other events flush them first. */
+
+static Point2d motion, wheel;
+
+static void
+on_mouse_flush(void)
+{
+	if(motion.mode)
+		motion.mode = 0, on_mouse_move(motion.x, motion.y);
+	if(wheel.mode) {
+		on_mouse_wheel(wheel.x, wheel.y);
+		wheel.x = wheel.y = wheel.mode = 0;
+	}
+}
+
+static void
+on_mouse_motion(int x, int y)
+{
+	if(wheel.mode)
+		on_mouse_flush();
+	motion.x = x, motion.y = y, motion.mode = 1;
+}
+
+static void
+on_mouse_scroll(int x, int y)
+{
+	if(motion.mode)
+		on_mouse_flush();
+	wheel.x += x, wheel.y += y, wheel.mode = 1;
+}
+
 /* = CONTROL ===================================== */
 
 static Uint8
@@ -538,6 +1741,7 @@ on_controller_special(char c, Uint8 fkey)
 		switch(fkey) {
 		case 1: por_lock(v); return;
 		case 2: por_center(v); return;
+		case 3: por_force(v); return;
 		case 4: por_close(v); return;
 		case 5: por_restart(v, 1); return;
 		}
@@ -546,6 +1750,9 @@ on_controller_special(char c, Uint8 fkey)
 	case 0x1b: por_setaction(NORMAL); return;
 	case 'd': por_setaction(action == DRAW ? NORMAL : DRAW); return;
 	case 'm': por_setaction(action == MOVE ? NORMAL : MOVE); return;
+	case '+':
+	case '=': por_zoom(zoom + 1); return;
+	case '-': por_zoom(zoom - 1); return;
 	}
 }
 
@@ -594,7 +1801,20 @@ on_controller_up(Uint8 button)
 static void
 emu_end(void)
 {
-	free(ram), free(pixels);
+	int i;
+	work_end();
+	io_end();
+	free(ram);
+	for(i = 0; i < RAM_PAGES; i++)
+		free(banks[i]), banks[i] = NULL, file_free(&varvaras[i]);
+	for(i = 0; i < RAM_PAGES * 0x10; i++)
+		free(queues[i >> 4][i & 0xf].type), free(queues[i >> 4][i & 0xf].value), free(queues[i >> 4][i & 0xf].data);
+	for(i = 0; i < 3; i++)
+		SDL_FreeCursor(gCursors[i]), gCursors[i] = NULL;
+	free(backdrop);
+	for(i = 0; i < RAM_PAGES; i++)
+		free(thumbs[i].pixels), thumbs[i].pixels = NULL;
+	SDL_FreeFormat(gFormat), gFormat = NULL;
 	SDL_DestroyTexture(gTexture), gTexture = NULL;
 	SDL_DestroyRenderer(gRenderer), gRenderer = NULL;
 	SDL_DestroyWindow(gWindow), gWindow = NULL;
@@ -602,9 +1822,24 @@ emu_end(void)
 	exit(0);
 }
 
+static Uint32
+get_format(void)
+{
+	Uint32 i, f;
+	SDL_RendererInfo info;
+	if(!SDL_GetRendererInfo(gRenderer, &info))
+		for(i = 0; i < info.num_texture_formats; i++) {
+			f = info.texture_formats[i];
+			if(!SDL_ISPIXELFORMAT_FOURCC(f) && SDL_BYTESPERPIXEL(f) == 4 && SDL_PIXELLAYOUT(f) == SDL_PACKEDLAYOUT_8888)
+				return f;
+		}
+	return SDL_PIXELFORMAT_ARGB8888;
+}
+
 static int
 init(void)
 {
+	Uint32 format;
 	if(SDL_Init(SDL_INIT_VIDEO) < 0)
 		return system_error("Init", SDL_GetError());
 	SDL_GetCurrentDisplayMode(0, &DM);
@@ -617,13 +1852,19 @@ init(void)
 	gRenderer = SDL_CreateRenderer(gWindow, -1, 0);
 	if(gRenderer == NULL)
 		return system_error("Renderer", SDL_GetError());
-	gTexture = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, WIDTH, HEIGHT);
+	format = get_format();
+	gTexture = SDL_CreateTexture(gRenderer, format, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
 	if(gTexture == NULL)
 		return system_error("Texture", SDL_GetError());
-	pixels = (Uint32 *)malloc(WIDTH * HEIGHT * sizeof(Uint32));
-	if(pixels == NULL)
-		return system_error("Pixels", "Failed to allocate memory");
-	SDL_ShowCursor(0);
+	SDL_SetTextureBlendMode(gTexture, SDL_BLENDMODE_NONE);
+	gFormat = SDL_AllocFormat(format);
+	if(gFormat == NULL)
+		return system_error("Format", SDL_GetError());
+	backdrop = (Uint32 *)malloc(WIDTH * HEIGHT * sizeof(Uint32));
+	if(backdrop == NULL)
+		return system_error("Backdrop", "Failed to allocate memory");
+	work_init();
+	io_init();
 	return 1;
 }
 
@@ -636,15 +1877,30 @@ graph_deo(Varvara *a, Uint8 addr, Uint8 value)
 			send_msg(0, a->u.dev[0x17], value);
 		else
 			for(i = 0; i < a->clen; i++)
-				send_msg(a->routes[i], a->u.dev[0x17], value);
-	}
+				route_send(a, i, a->u.dev[0x17], value);
+	} else if(addr == 0x13) {
+		for(i = 0; i < a->clen; i++)
+			sources[a->routes[i]->u.id] = a->u.id + 1, route_send(a, i, CONSOLE_BANK, value);
+	} else if(addr == 0x16) {
+		POKE2(&a->u.dev[0x14], route_stat(a, value))
+	} else if(addr == 0x1f)
+		route_bulk(a, PEEK2(&a->u.dev[0x1e]), PEEK2(&a->u.dev[0x1c]));
 }
 
 Uint8
 emu_dei(Uxn *u, Uint8 addr)
 {
+	Uint8 value;
 	switch(addr & 0xf0) {
 	case 0xc0: return datetime_dei(u, addr); break;
+	case 0xd0:
+		if(addr & 0x3)
+			break;
+		io_wait(pending[u->id][addr >> 3 & 0x1]);
+		SDL_LockMutex(fslock);
+		value = file_dei(&varvaras[u->id], addr >> 3 & 0x1, &u->dev[addr & 0xf8], addr & 0x7);
+		SDL_UnlockMutex(fslock);
+		return value;
 	}
 	return u->dev[addr];
 }
@@ -659,36 +1915,59 @@ emu_deo(Uxn *u, Uint8 addr, Uint8 value)
 	case 0x00:
 		if(p > 0x7 && p < 0xe) {
 			screen_palette(prg->screen.palette, &u->dev[0x8]);
-			screen_change(&prg->screen, 0, 0, prg->screen.w, prg->screen.h);
+			map_palette(prg->screen.palette);
+			if(indexed) /* the thumb holds the old colours, rebuild it */
+				thumbs[u->id].level = 0x10, draw_touch(prg);
+			else
+				screen_change(&prg->screen, 0, 0, prg->screen.w, prg->screen.h);
 		}
+		if(p == 0x3) por_expand(prg);
 		if(p == 0xf) por_pop(prg);
 		break;
 	case 0x10: graph_deo(prg, addr, value); break;
-	case 0x20: screen_deo(prg, u->ram, &u->dev[d], p); break;
-	case 0xa0: file_deo(0, u->ram, &u->dev[d], p); break;
-	case 0xb0: file_deo(1, u->ram, &u->dev[d], p); break;
+	case 0x20:
+		if(p == 0x3 || p == 0x5) draw_touch(prg);
+		screen_deo(prg, u->ram, &u->dev[d], p);
+		if(p == 0x3 || p == 0x5) grid_update(prg), draw_touch(prg);
+		break;
+	case 0xa0: por_file(prg, 0, &u->dev[d], p); break;
+	case 0xb0: por_file(prg, 1, &u->dev[d], p); break;
+	case 0xd0:
+		if((p & 0x7) != 0x3)
+			break;
+		io_wait(pending[u->id][p >> 3]);
+		SDL_LockMutex(fslock);
+		file_offset(prg, p >> 3, &u->dev[addr & 0xf8], p & 0x7);
+		SDL_UnlockMutex(fslock);
+		break;
 	}
 }
 
 int
 main(int argc, char **argv)
 {
-	int i, anchor = 0;
-	Uint32 begintime = 0, endtime = 0, delta = 0;
+	int i, dlen, slen, first, anchor = 0;
+	Varvara *sched[RAM_PAGES];
+	Uint32 shown, begintime = 0, endtime = 0, delta = 0;
 	/* Read flags */
-	if(argc == 2 && argv[1][0] == '-' && argv[1][1] == 'v')
-		return !fprintf(stdout, "Porporo - Varvara Multiplexer, 18 Dec 2023.\n");
+	for(i = 1; i < argc && argv[i][0] == '-'; i++) {
+		switch(argv[i][1]) {
+		case 'v': return !fprintf(stdout, "Porporo - Varvara Multiplexer, 18 Dec 2023.\n");
+		case 'i': indexed = 1; break;
+		}
+	}
 	if(!init())
 		return system_error("Init", "Failure");
 	/* Boot */
 	ram = (Uint8 *)calloc(0x10000 * RAM_PAGES, 1);
 	load_theme();
-	menu = por_prefab(0, menu_rom, sizeof(menu_rom), 0);
-	wallpaper = por_push(por_prefab(1, wallpaper_rom, sizeof(wallpaper_rom), 1), 0, 0, 1);
-	potato = por_push(por_prefab(2, potato_rom, sizeof(potato_rom), 1), 0x10, 0x10, 1);
-	for(i = 1; i < argc; i++) {
-		Varvara *a = por_push(por_spawn(i + 2, argv[i], 1), anchor + 0x12, 0x38, 0);
-		anchor += a->screen.w + 0x10;
+	load_cursors();
+	menu = por_prefab(0, menu_rom, sizeof(menu_rom), 0, 0);
+	wallpaper = por_push(por_prefab(1, wallpaper_rom, sizeof(wallpaper_rom), 1, 0), 0, 0, 1);
+	potato = por_push(por_prefab(2, potato_rom, sizeof(potato_rom), 1, 0), 0x10, 0x10, 1);
+	for(first = i, argn = argc - i; i < argc; i++) {
+		Varvara *a = por_push(por_spawn(i - first + 3, argv[i]), anchor + 0x12, 0x38, 0);
+		laid[a->u.id] = a->x, anchor += a->screen.w + 0x10;
 	}
 	/* Game Loop */
 	while(1) {
@@ -700,10 +1979,17 @@ main(int argc, char **argv)
 		if(delta < 30)
 			SDL_Delay(30 - delta);
 		while(SDL_PollEvent(&e) != 0) {
+			if(e.type == SDL_MOUSEWHEEL) {
+				on_mouse_scroll(e.wheel.x, e.wheel.y);
+				continue;
+			}
+			if(e.type == SDL_MOUSEMOTION) {
+				on_mouse_motion(e.motion.x, e.motion.y);
+				continue;
+			}
+			on_mouse_flush();
 			switch(e.type) {
 			case SDL_QUIT: emu_end(); break;
-			case SDL_MOUSEWHEEL: on_mouse_wheel(e.wheel.x, e.wheel.y); break;
-			case SDL_MOUSEMOTION: on_mouse_move(e.motion.x, e.motion.y); break;
 			case SDL_MOUSEBUTTONDOWN: on_mouse_down(SDL_BUTTON(e.button.button), e.motion.x, e.motion.y); break;
 			case SDL_MOUSEBUTTONUP: on_mouse_up(SDL_BUTTON(e.button.button), e.motion.x, e.motion.y); break;
 			case SDL_TEXTINPUT: on_controller_input(e.text.text[0]); break;
@@ -712,32 +1998,56 @@ main(int argc, char **argv)
 			case SDL_WINDOWEVENT: reqdraw = 1; break;
 			}
 		}
-		/* Screen Vector */
-		for(i = 0; i < olen; i++) {
+		on_mouse_flush();
+		draw_cursor();
+		io_poll();
+		route_bridges();
+		bridge_reap();
+		/* Screen Vector, producers before consumers */
+		shown = grid_area(0, 0, WIDTH, HEIGHT);
+		slen = route_schedule(sched);
+		for(i = 0; i < slen; i++) {
+			Varvara *v = sched[i];
+			Uint16 vector = PEEK2(&v->u.dev[0x20]);
+			int j = 0;
+			if(!v->live) continue;
+			route_inbox(v);
+			while(j < olen && order[j] != v)
+				j++;
+			if(vector && j < olen && por_awake(j, shown) && !route_held(v))
+				uxn_eval(&v->u, vector);
+		}
+		/* a second round of file completions for chained requests */
+		io_poll();
+		for(i = 0, dlen = 0; i < olen; i++) {
 			Varvara *v = order[i];
-			Uxn *u = &v->u;
-			Uint8 *address = &u->dev[0x20];
-			Uint16 vector = PEEK2(address);
-			if(vector)
-				uxn_eval(u, vector);
 			if(v->screen.x2) {
-				screen_redraw(&v->screen);
-				reqdraw = 1;
+				Screen *scr = &v->screen;
+				Rect2d r;
+				get_rect(v, &r);
+				if(v->lock) {
+					r.x2 = r.x1 + (scr->x2 < scr->w ? scr->x2 : scr->w), r.y2 = r.y1 + (scr->y2 < scr->h ? scr->y2 : scr->h);
+					r.x1 += scr->x1, r.y1 += scr->y1;
+				} else {
+					r.x2 = r.x1 + get_length(scr->x2 < scr->w ? scr->x2 : scr->w), r.y2 = r.y1 + get_length(scr->y2 < scr->h ? scr->y2 : scr->h);
+					r.x1 += get_scaled(scr->x1), r.y1 += get_scaled(scr->y1);
+				}
+				draw_damage(r.x1, r.y1, r.x2, r.y2);
+				if(i < blen) draw_stale(r.x1, r.y1, r.x2, r.y2);
+				dirty[dlen++] = v;
 			}
 		}
+		if(dlen)
+			work_run(draw_screen, dlen);
 		/* Draw */
-		if(reqdraw) {
-			for(i = 0; i < olen; i++)
-				draw_window(order[i]);
-			if(cursor.mode)
-				draw_icn(cursor.x, cursor.y, &cursor_icn[action * 8], palette[1 + action]);
-			SDL_UpdateTexture(gTexture, NULL, pixels, WIDTH * sizeof(Uint32));
-			SDL_RenderCopy(gRenderer, gTexture, NULL, NULL);
-			SDL_RenderPresent(gRenderer);
-			reqdraw = 0;
-		}
+		if(!(frames & 0x1f))
+			route_tally();
+		if(reqdraw || dmlen)
+			draw_frame();
+		io_flush();
 		begintime = endtime;
 		endtime = SDL_GetTicks();
+		frames++;
 	}
 	emu_end();
 	return 0;
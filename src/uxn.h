@@ -43,10 +43,11 @@ typedef struct Screen {
 typedef struct Varvara {
 	char rom[0x40];
 	int x, y, clen;
-	Uint8 live, lock;
+	Uint8 live, lock, force;
 	Uxn u;
 	Screen screen;
 	struct Varvara *routes[0x10];
+	struct UxnFile *files;
 } Varvara;
 
 /* required functions */
@@ -26,6 +26,7 @@ emu_dei(Uxn *u, Uint8 addr)
 	switch(addr & 0xf0) {
 	case 0x00: return system_dei(u, addr);
 	case 0xc0: return datetime_dei(u, addr);
+	case 0xd0: return file_dei(&v, addr >> 3 & 0x1, &u->dev[addr & 0xf8], addr & 0x7);
 	}
 	return u->dev[addr];
 }
@@ -38,8 +39,9 @@ emu_deo(Uxn *u, Uint8 addr, Uint8 value)
 	switch(d) {
 	case 0x00: system_deo(u, &u->dev[d], addr & 0x0f); break;
 	case 0x10: console_deo(&u->dev[d], addr & 0x0f); break;
-	case 0xa0: file_deo(0, u->ram, &u->dev[d], addr & 0x0f); break;
-	case 0xb0: file_deo(1, u->ram, &u->dev[d], addr & 0x0f); break;
+	case 0xa0: file_deo(&v, 0, u->ram, &u->dev[d], addr & 0x0f); break;
+	case 0xb0: file_deo(&v, 1, u->ram, &u->dev[d], addr & 0x0f); break;
+	case 0xd0: file_offset(&v, addr >> 3 & 0x1, &u->dev[addr & 0xf8], addr & 0x7); break;
 	}
 }
 
@@ -47,7 +49,9 @@ static void
 emu_run(Uxn *u)
 {
 	while(!u->dev[0x0f]) {
-		int c = fgetc(stdin);
+		int c;
+		file_flush(&v);
+		c = fgetc(stdin);
 		if(c == EOF) {
 			console_input(u, 0x00, CONSOLE_END);
 			break;
@@ -60,6 +64,7 @@ static int
 emu_end(Uxn *u)
 {
 	free(u->ram);
+	file_free(&v);
 	return u->dev[0x0f] & 0x7f;
 }
 